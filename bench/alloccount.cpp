@@ -0,0 +1,61 @@
+/* -*- C++ -*-
+ *
+ *  alloccount.cpp - Allocation counting for the Ponscripter benchmarks
+ *
+ *  Every C++ allocation, and every pstring buffer bstrlib allocates
+ *  when built with BSTRLIB_MEMORY_DEBUG (see memdbg.h), is counted in
+ *  bench_allocations, so each benchmark can report what its work
+ *  allocates.
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+#include "memdbg.h"
+#include <stdlib.h>
+#include <new>
+
+unsigned long bench_allocations = 0;
+
+void* operator new(size_t size)
+{
+    ++bench_allocations;
+    void* p = malloc(size ? size : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void* operator new[](size_t size)
+{
+    ++bench_allocations;
+    void* p = malloc(size ? size : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void* p) throw() { free(p); }
+void operator delete[](void* p) throw() { free(p); }
+
+void* bench_alloc(size_t size)
+{
+    ++bench_allocations;
+    return malloc(size);
+}
+
+void* bench_realloc(void* p, size_t size)
+{
+    ++bench_allocations;
+    return realloc(p, size);
+}
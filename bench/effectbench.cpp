@@ -0,0 +1,327 @@
+/* -*- C++ -*-
+ *
+ *  effectbench.cpp - Effect benchmark for Ponscripter
+ *
+ *  Runs every built-in effect (0 to 18, the three quakes and the
+ *  emulated DLL effects) from a synthetic old image to a synthetic new
+ *  one at a fixed number of frames, through the same setEffect() and
+ *  doEffect() the game uses, and reports the time per frame, the pixels
+ *  drawn per second and a checksum of the frames drawn.  The checksums
+ *  are the same with and without --disable-cpu-gfx, but for effect 15,
+ *  whose mask the plain blend applies without the accelerated ramp.
+ *
+ *  Usage: effectbench [-n frames] [-s WIDTHxHEIGHT] [--disable-cpu-gfx]
+ *                     [directory]
+ *
+ *  Each effect is drawn at its start and then in the given number of
+ *  equal steps (60 by default) to its end.  The resolution is any of
+ *  the script's ;mode sizes (320x240, 400x300, 640x480, 800x600,
+ *  640x360, 960x540, 1280x720 and 1920x1080), and defaults to
+ *  1280x720.  A small script is written to the directory, which
+ *  defaults to the current one, to start the engine at that size; it
+ *  and the compiled script cached beside it are removed at exit.
+ *  SDL's dummy video and audio drivers and its software renderer are
+ *  used unless others are set, so it runs without a display.
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+#include "PonscripterLabel.h"
+
+static const struct {
+    const char* size;
+    const char* mode;
+} modes[] = {
+    { "320x240",   "320"   },
+    { "400x300",   "400"   },
+    { "640x480",   "640"   },
+    { "800x600",   "800"   },
+    { "640x360",   "w360"  },
+    { "960x540",   "w540"  },
+    { "1280x720",  "w720"  },
+    { "1920x1080", "w1080" },
+};
+static const int num_modes = sizeof(modes) / sizeof(modes[0]);
+
+static const struct BenchEffect {
+    const char* name;
+    int effect, no;
+    const char* dll;
+} effects[] = {
+    { "instant",              0, 0, NULL },
+    { "instant",              1, 0, NULL },
+    { "left shutter",         2, 0, NULL },
+    { "right shutter",        3, 0, NULL },
+    { "top shutter",          4, 0, NULL },
+    { "bottom shutter",       5, 0, NULL },
+    { "left curtain",         6, 0, NULL },
+    { "right curtain",        7, 0, NULL },
+    { "top curtain",          8, 0, NULL },
+    { "bottom curtain",       9, 0, NULL },
+    { "crossfade",           10, 0, NULL },
+    { "left scroll",         11, 0, NULL },
+    { "right scroll",        12, 0, NULL },
+    { "top scroll",          13, 0, NULL },
+    { "bottom scroll",       14, 0, NULL },
+    { "fade with mask",      15, 0, NULL },
+    { "mosaic out",          16, 0, NULL },
+    { "mosaic in",           17, 0, NULL },
+    { "crossfade with mask", 18, 0, NULL },
+    { "quakey",  CUSTOM_EFFECT_NO + 0, 4, NULL },
+    { "quakex",  CUSTOM_EFFECT_NO + 1, 4, NULL },
+    { "quake",   CUSTOM_EFFECT_NO + 2, 4, NULL },
+    { NULL,                 99, 0, "cascade.dll/u" },
+    { NULL,                 99, 0, "cascade.dll/rx" },
+    { NULL,                 99, 0, "whirl.dll/l" },
+    { NULL,                 99, 0, "trvswave.dll/" },
+    { NULL,                 99, 0, "breakup.dll/rlp" },
+    { NULL,                 99, 0, "breakup.dll/llB" },
+};
+static const int num_effects = sizeof(effects) / sizeof(effects[0]);
+
+enum { DURATION = 1000 };
+
+static double seconds()
+{
+    return SDL_GetPerformanceCounter() / double(SDL_GetPerformanceFrequency());
+}
+
+
+// Old image: smooth gradients.  New image: blocks and stripes.  Mask:
+// a diagonal ramp with some grain, as scanned masks have.
+enum Pattern { OLD_IMAGE, NEW_IMAGE, MASK };
+
+static SDL_Surface* pattern(int w, int h, Pattern kind)
+{
+    SDL_Surface* s = AnimationInfo::allocSurface(w, h);
+    SDL_LockSurface(s);
+    for (int y = 0; y < h; ++y) {
+        Uint32* p = (Uint32*) ((Uint8*) s->pixels + y * s->pitch);
+        for (int x = 0; x < w; ++x) {
+            int r, g, b;
+            if (kind == OLD_IMAGE) {
+                r = x * 255 / w;
+                g = y * 255 / h;
+                b = (x ^ y) & 0xff;
+            }
+            else if (kind == NEW_IMAGE) {
+                r = ((x / 32 + y / 32) & 1) ? 0xe0 : 0x20;
+                g = (x + y) & 0xff;
+                b = (y & 8) ? 0xff - r : r;
+            }
+            else {
+                int v = (x * 255 / w + y * 255 / h) / 2 +
+                        (((x * 7) ^ (y * 13)) & 15) - 8;
+                r = g = b = std::max(0, std::min(255, v));
+            }
+            p[x] = SDL_MapRGBA(s->format, r, g, b, 0xff);
+        }
+    }
+    SDL_UnlockSurface(s);
+    return s;
+}
+
+
+static Uint32 checksum(SDL_Surface* s, Uint32 sum)
+{
+    SDL_LockSurface(s);
+    for (int y = 0; y < s->h; ++y) {
+        const Uint32* p = (const Uint32*) ((Uint8*) s->pixels + y * s->pitch);
+        for (int x = 0; x < s->w; ++x) sum = (sum ^ p[x]) * 16777619u;
+    }
+    SDL_UnlockSurface(s);
+    return sum;
+}
+
+
+class EffectBench {
+    PonscripterLabel& ons;
+    SDL_Surface *old_image, *new_image;
+
+public:
+    struct Result {
+        int frames;
+        double setup, time;
+        Uint32 sum;
+    };
+
+    EffectBench(PonscripterLabel& ons) : ons(ons)
+    {
+        old_image = pattern(ons.screen_width, ons.screen_height, OLD_IMAGE);
+        new_image = pattern(ons.screen_width, ons.screen_height, NEW_IMAGE);
+    }
+
+    ~EffectBench()
+    {
+        SDL_FreeSurface(old_image);
+        SDL_FreeSurface(new_image);
+    }
+
+    double pixels() const
+    {
+        return double(ons.screen_width) * ons.screen_height;
+    }
+
+    // Runs one effect from the old image to the new, each frame a fixed
+    // step of the duration apart, however long the frames take to draw.
+    Result run(const BenchEffect& b, int frames)
+    {
+        PonscripterLabel::Effect effect;
+        effect.no = b.no;
+        effect.effect = b.effect;
+        effect.duration = DURATION;
+        if (b.dll) effect.anim.image_name = b.dll;
+        if (b.effect == 15 || b.effect == 18)
+            effect.anim.image_surface =
+                pattern(ons.screen_width, ons.screen_height, MASK);
+
+        SDL_BlitSurface(old_image, NULL, ons.accumulation_surface, NULL);
+        SDL_BlitSurface(new_image, NULL, ons.effect_dst_surface, NULL);
+        ons.dirty_rect.fill(ons.screen_width, ons.screen_height);
+        init_rnd(1);
+
+        Result r;
+        r.frames = 0;
+        r.time = 0;
+        r.sum = 2166136261u;
+        double start = seconds();
+        int ret = ons.setEffect(effect, false, false);
+        r.setup = seconds() - start;
+
+        if (ret & PonscripterLabel::RET_WAIT) {
+            // Rounded up, so the last frame is the end of the effect.
+            ons.effect_frame_ticks =
+                (SDL_GetPerformanceFrequency() * DURATION / 1000 + frames - 1)
+                / frames;
+            do {
+                start = seconds();
+                // Half an interval ahead of the refresh for this frame,
+                // which doEffect() then draws for.
+                ons.effect_origin = SDL_GetPerformanceCounter() -
+                    Uint64(r.frames) * ons.effect_frame_ticks +
+                    ons.effect_frame_ticks / 2;
+                ret = ons.doEffect(effect);
+                r.time += seconds() - start;
+                r.sum = checksum(ons.accumulation_surface, r.sum);
+                ++r.frames;
+            } while (ret & PonscripterLabel::RET_WAIT);
+        }
+        else
+            r.sum = checksum(ons.accumulation_surface, r.sum);
+
+        // setEffect() asks for a redraw that the event loop isn't here
+        // to take.
+        SDL_FlushEvents(SDL_FIRSTEVENT, SDL_LASTEVENT);
+        return r;
+    }
+};
+
+
+// Removes the script and its cache however the program ends, as
+// init() exits on some errors rather than returning.
+static pstring script, cache;
+
+static void remove_script()
+{
+    remove(script);
+    remove(cache);
+}
+
+
+static void usage()
+{
+    fprintf(stderr, "Usage: effectbench [-n frames] [-s WIDTHxHEIGHT] "
+            "[--disable-cpu-gfx] [directory]\n");
+    exit(1);
+}
+
+
+int main(int argc, char** argv)
+{
+    int frames = 60;
+    const char* size = "1280x720";
+    bool cpu_gfx = true;
+    pstring dir = ".";
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-n")) {
+            if (++i == argc) usage();
+            frames = atoi(argv[i]);
+            if (frames < 1) usage();
+        }
+        else if (!strcmp(argv[i], "-s")) {
+            if (++i == argc) usage();
+            size = argv[i];
+        }
+        else if (!strcmp(argv[i], "--disable-cpu-gfx"))
+            cpu_gfx = false;
+        else if (argv[i][0] == '-')
+            usage();
+        else
+            dir = argv[i];
+    }
+
+    int m = 0;
+    while (m < num_modes && strcmp(modes[m].size, size)) ++m;
+    if (m == num_modes) {
+        fprintf(stderr, "effectbench: no ;mode for %s\n", size);
+        return 1;
+    }
+
+    script = dir + DELIMITER + "effectbench.utf";
+    cache = dir + DELIMITER + "pscode.dat";
+    FILE* fp = fopen(script, "wb");
+    if (!fp) {
+        fprintf(stderr, "effectbench: can't write %s\n",
+                (const char*) script);
+        return 1;
+    }
+    fprintf(fp, ";mode%s\n*define\ngame\n*start\nend\n", modes[m].mode);
+    fclose(fp);
+    atexit(remove_script);
+
+    SDL_setenv("SDL_VIDEODRIVER", "dummy", 0);
+    SDL_setenv("SDL_AUDIODRIVER", "dummy", 0);
+    SDL_setenv("SDL_RENDER_DRIVER", "software", 0);
+
+    PonscripterLabel ons;
+    ons.setArchivePath(dir);
+    ons.setSavePath(dir);
+    if (!cpu_gfx) ons.disableCpuGfx();
+    if (ons.init(script)) return 1;
+    remove_script();
+
+    EffectBench bench(ons);
+
+    printf("resolution:   %s\n", size);
+    printf("graphics:     %s\n", cpu_gfx ? "cpu" : "plain");
+    printf("frames:       %d per %dms effect, the first at its start\n\n",
+           frames + 1, DURATION);
+    printf("effect                   frames  setup ms  ms/frame  Mpixels/s"
+           "  checksum\n");
+    for (int i = 0; i < num_effects; ++i) {
+        const BenchEffect& b = effects[i];
+        EffectBench::Result r = bench.run(b, frames);
+
+        char name[64];
+        snprintf(name, sizeof name, "%3d %s", b.effect, b.dll ? b.dll : b.name);
+        double per_frame = r.frames ? r.time / r.frames : 0;
+        printf("%-24s %6d  %8.3f  %8.3f  %9.1f  %08x\n", name, r.frames,
+               r.setup * 1000, per_frame * 1000,
+               per_frame > 0 ? bench.pixels() / per_frame / 1e6 : 0.0, r.sum);
+    }
+
+    return 0;
+}
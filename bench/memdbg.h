@@ -0,0 +1,47 @@
+/* -*- C++ -*-
+ *
+ *  memdbg.h - Allocation hooks for the Ponscripter benchmarks
+ *
+ *  bstrlib includes this in place of its own memory debugging header
+ *  when built with BSTRLIB_MEMORY_DEBUG, and then allocates through
+ *  the functions named here.  alloccount.cpp defines them, and counts
+ *  what they and C++ allocate in bench_allocations.
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+#ifndef __BENCH_MEMDBG_H__
+#define __BENCH_MEMDBG_H__
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern unsigned long bench_allocations;
+
+void* bench_alloc(size_t size);
+void* bench_realloc(void* p, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#define bstr__alloc(x) bench_alloc (x)
+#define bstr__realloc(p,x) bench_realloc ((p), (x))
+
+#endif
@@ -0,0 +1,147 @@
+/* -*- C++ -*-
+ *
+ *  scriptbench.cpp - Script interpreter benchmark for Ponscripter
+ *
+ *  Loads a game script, runs its define section, and then repeatedly
+ *  calls the subroutine at its *expressions label, whose arithmetic
+ *  statements (mov, add, sub and the like, on integer and array
+ *  variables) go through the same ScriptParser command dispatch the
+ *  game uses.  It reports statements per second and the allocations
+ *  they make, both C++ ones and those of pstring buffers.  bench/interp
+ *  holds a suitable script, which can also be run as a game to time the
+ *  whole interpreter.
+ *
+ *  Usage: scriptbench [-n passes] [directory]
+ *
+ *  The directory defaults to the current one.
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+#include "ScriptParser.h"
+#include "memdbg.h"
+
+
+static double seconds()
+{
+    return SDL_GetPerformanceCounter() / double(SDL_GetPerformanceFrequency());
+}
+
+
+class ScriptBench : public ScriptParser {
+    // Runs statements through parseLine(), as executeLabel() does, until
+    // one the parser leaves to PonscripterLabel or a return from the
+    // subroutine they're in.  Returns the number run.
+    unsigned long execute()
+    {
+        unsigned long statements = 0;
+        NestInfo::vector::size_type depth = nest_infos.size();
+        readToken();
+        while (1) {
+            const pstring& cmd = script_h.getStrBuf();
+            bool statement = !script_h.isText() && cmd[0] != 0x0a &&
+                cmd[0] != ':' && cmd[0] != ';' && cmd[0] != '*';
+
+            int ret = parseLine();
+            if (ret == RET_NOMATCH || nest_infos.size() < depth) break;
+            if (statement) ++statements;
+
+            if (ret & RET_SKIP_LINE) script_h.skipLine();
+            if (!(ret & RET_NOREAD)) readToken();
+        }
+        return statements;
+    }
+
+public:
+    int open(const pstring& dir)
+    {
+        archive_path.add(dir);
+        if (ScriptParser::open(NULL)) return -1;
+        script_h.compileScript(); // caches to the current directory
+
+        // Start as definereset does, and run the define section's
+        // numalias and dim statements; it ends at game, which is
+        // PonscripterLabel's.
+        script_h.reset();
+        reset();
+        setCurrentLabel("define");
+        execute();
+        return 0;
+    }
+
+    bool has_label(const pstring& label)
+    {
+        return script_h.lookupLabel(label).start_address != NULL;
+    }
+
+    // Calls the subroutine at label, as gosub would.
+    unsigned long run(const pstring& label)
+    {
+        gosubReal(label, script_h.getCurrent());
+        return execute();
+    }
+};
+
+
+static void usage()
+{
+    fprintf(stderr, "Usage: scriptbench [-n passes] [directory]\n");
+    exit(1);
+}
+
+
+int main(int argc, char** argv)
+{
+    int passes = 100000;
+    pstring dir = ".";
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-n")) {
+            if (++i == argc) usage();
+            passes = atoi(argv[i]);
+        }
+        else if (argv[i][0] == '-')
+            usage();
+        else
+            dir = argv[i];
+    }
+    if (!dir.ends_with(DELIMITER)) dir += DELIMITER;
+
+    ScriptBench bench;
+    if (bench.open(dir)) return 1;
+    const pstring label = "expressions";
+    if (!bench.has_label(label)) {
+        fprintf(stderr, "scriptbench: no *expressions label\n");
+        return 1;
+    }
+
+    // One untimed pass, to create any variables used.
+    bench.run(label);
+
+    unsigned long statements = 0, allocs = bench_allocations;
+    double start = seconds();
+    for (int i = 0; i < passes; ++i)
+        statements += bench.run(label);
+    double time = seconds() - start;
+    allocs = bench_allocations - allocs;
+
+    printf("script:       %s\n", (const char*) dir);
+    printf("passes:       %d\n", passes);
+    printf("statements:   %lu in %.3fs, %.0f statements/sec\n",
+           statements, time, statements / time);
+    printf("allocations:  %lu, %.2f per statement\n",
+           allocs, double(allocs) / statements);
+    return 0;
+}
@@ -0,0 +1,318 @@
+/* -*- C++ -*-
+ *
+ *  textbench.cpp - Text rendering benchmark for Ponscripter
+ *
+ *  Runs a fixed corpus through the same font pipeline the game uses
+ *  (ligature decoding, kinsoku-free line filling, glyph rendering with
+ *  shadows, and blending into a text layer) with no game or display,
+ *  so that changes to fonts or text drawing can be compared from one
+ *  release to the next.  It first checks, with subpixel positioning
+ *  on, that glyphs drawn with shadows have the same fill as without.
+ *
+ *  Usage: textbench [-n passes] [font.ttf]
+ *
+ *  With no font given, default.ttf is looked for in the current
+ *  directory, as in a game directory.  Set SDL_VIDEODRIVER=dummy to run
+ *  without a display; no window is opened in any case.
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+#include "Fontinfo.h"
+#include "AnimationInfo.h"
+#include "DirPaths.h"
+#include "DirectReader.h"
+#include "ScriptHandler.h"
+#include "encoding.h"
+#include "memdbg.h"
+
+
+static const char* corpus[] = {
+    // Latin, with the default ligature set
+    "O how I love thee, pie! I eat of thee each day. The quick brown fox "
+    "jumps over the lazy dog; ``quoted'' text -- with dashes --- and "
+    "efficient, fluffy, affluent office ligatures.",
+    // Japanese
+    "\xe5\x90\xbe\xe8\xbc\xa9\xe3\x81\xaf\xe7\x8c\xab\xe3\x81\xa7\xe3\x81"
+    "\x82\xe3\x82\x8b\xe3\x80\x82\xe5\x90\x8d\xe5\x89\x8d\xe3\x81\xaf\xe3"
+    "\x81\xbe\xe3\x81\xa0\xe7\x84\xa1\xe3\x81\x84\xe3\x80\x82\xe3\x81\xa9"
+    "\xe3\x81\x93\xe3\x81\xa7\xe7\x94\x9f\xe3\x82\x8c\xe3\x81\x9f\xe3\x81"
+    "\x8b\xe3\x81\xa8\xe3\x82\x93\xe3\x81\xa8\xe8\xa6\x8b\xe5\xbd\x93\xe3"
+    "\x81\x8c\xe3\x81\xa4\xe3\x81\x8b\xe3\x81\xac\xe3\x80\x82\xe3\x80\x8c"
+    "\xe4\xbd\x95\xe3\x81\xa7\xe3\x82\x82\xe8\x96\x84\xe6\x9a\x97\xe3\x81"
+    "\x84\xe3\x81\x98\xe3\x82\x81\xe3\x81\x98\xe3\x82\x81\xe3\x81\x97\xe3"
+    "\x81\x9f\xe6\x89\x80\xe3\x81\xa7\xe3\x80\x8d",
+    // Mixed scripts and styles
+    "~i~Italic~i~ and ~b~bold~b~ and ~i~~b~both~d~, then \xe6\x97\xa5\xe6"
+    "\x9c\xac\xe8\xaa\x9e in the middle of a ~f~sans~f~ sentence.",
+    // Size tags
+    "~s+8~Larger~s-8~ and ~%50~half-size~=26~ text, ~=40~big~=26~, "
+    "~s-6~small~s+6~ again.",
+};
+static const int corpus_lines = sizeof(corpus) / sizeof(corpus[0]);
+
+static double seconds()
+{
+    return SDL_GetPerformanceCounter() / double(SDL_GetPerformanceFrequency());
+}
+
+
+// Measures each line the way the line breaker and h_textextent do.
+// Returns the number of measurement calls made.
+static unsigned long measure(Fontinfo& f, const pstring* text)
+{
+    unsigned long calls = 0;
+    for (int i = 0; i < corpus_lines; ++i) {
+        f.clear();
+        f.StringAdvance(text[i]);
+        ++calls;
+
+        const char* it = text[i];
+        while (*it) {
+            int bytes;
+            wchar ch = file_encoding->DecodeWithLigatures(it, f, bytes);
+            if (!f.processCode(it)) {
+                wchar next = file_encoding->DecodeWithLigatures(it + bytes, f);
+                f.GlyphAdvance(ch, next);
+                ++calls;
+            }
+            it += bytes;
+        }
+    }
+    return calls;
+}
+
+
+// Lays out and draws each line into the layer as drawChar() does for
+// the text window, shadow and all.  Returns the number of glyphs drawn.
+static unsigned long render(Fontinfo& f, AnimationInfo& layer,
+                            const pstring* text)
+{
+    static SDL_Color fg = { 0xff, 0xff, 0xff, 0 },
+                     bg = { 0, 0, 0, 0 },
+                     shadow = { 0, 0, 0, 0 };
+    unsigned long glyphs = 0;
+
+    layer.fill(0, 0, 0, 0);
+    f.clear();
+    for (int i = 0; i < corpus_lines; ++i) {
+        const char* it = text[i];
+        while (*it) {
+            int bytes;
+            wchar ch = file_encoding->DecodeWithLigatures(it, f, bytes);
+            if (f.processCode(it)) {
+                it += bytes;
+                continue;
+            }
+
+            wchar next = file_encoding->DecodeWithLigatures(it + bytes, f);
+            float adv = f.GlyphAdvance(ch, next);
+            if (f.isNoRoomFor(adv)) f.newLine();
+            if (f.isNoRoomForLines(1)) f.clear();
+
+            float minx, maxy;
+            float x = f.GetX();
+            f.doSize();
+            Font* font = f.font();
+            font->get_metrics(ch, &minx, NULL, NULL, &maxy);
+            float frac = x + minx - floor(x + minx);
+            Glyph g = font->render_glyph(ch, fg, bg, frac);
+            if (g.bitmap) {
+                const GlyphShadow& s = font->render_shadow(ch, frac, 1, 1);
+                int gx = int(floor(x + g.left)) + s.left;
+                int gy = f.GetY() + font->ascent() - int(ceil(g.top)) + s.top;
+                layer.blendText(s, gx, gy, fg, shadow, NULL);
+                ++glyphs;
+            }
+
+            f.advanceBy(adv);
+            it += bytes;
+        }
+        f.newLine();
+    }
+    return glyphs;
+}
+
+
+// Checks, with subpixel positioning on, that the fill in each glyph's
+// shadow coverage map is the plain glyph rendered at the same phase,
+// as drawGlyph() draws one or the other.  Returns the number that
+// differ.
+static unsigned long check(Fontinfo& f, const pstring* text)
+{
+    static SDL_Color fg = { 0xff, 0xff, 0xff, 0xff },
+                     bg = { 0, 0, 0, 0 };
+    unsigned long bad = 0;
+    const bool was_subpixel = subpixel;
+    subpixel = true;
+
+    f.clear();
+    for (int i = 0; i < corpus_lines; ++i) {
+        const char* it = text[i];
+        while (*it) {
+            int bytes;
+            wchar ch = file_encoding->DecodeWithLigatures(it, f, bytes);
+            if (f.processCode(it)) {
+                it += bytes;
+                continue;
+            }
+
+            wchar next = file_encoding->DecodeWithLigatures(it + bytes, f);
+            float adv = f.GlyphAdvance(ch, next);
+            if (f.isNoRoomFor(adv)) f.newLine();
+            if (f.isNoRoomForLines(1)) f.clear();
+
+            float minx, maxy;
+            float x = f.GetX();
+            f.doSize();
+            Font* font = f.font();
+            font->get_metrics(ch, &minx, NULL, NULL, &maxy);
+            float frac = x + minx - floor(x + minx);
+            Glyph g = font->render_glyph(ch, fg, bg, frac);
+            if (g.bitmap) {
+                // Copied, as the shadow may take over the glyph's slot.
+                const SDL_Surface* b = g.bitmap;
+                const int w = b->w, h = b->h;
+                std::vector<Uint8> plain(w * h);
+                for (int row = 0; row < h; ++row)
+                    memcpy(&plain[row * w],
+                           (const Uint8*) b->pixels + b->pitch * row, w);
+
+                const GlyphShadow& s = font->render_shadow(ch, frac, 1, 1);
+                bool same = s.w == w + 1 && s.h == h + 1;
+                for (int row = 0; same && row < h; ++row) {
+                    const Uint8* fill =
+                        &s.coverage[2 * ((row - s.top) * s.w - s.left) + 1];
+                    for (int col = 0; col < w; ++col)
+                        if (fill[2 * col] != plain[row * w + col])
+                            same = false;
+                }
+                if (!same) ++bad;
+            }
+
+            f.advanceBy(adv);
+            it += bytes;
+        }
+        f.newLine();
+    }
+
+    subpixel = was_subpixel;
+    return bad;
+}
+
+
+static void usage()
+{
+    fprintf(stderr, "Usage: textbench [-n passes] [font.ttf]\n");
+    exit(1);
+}
+
+
+int main(int argc, char** argv)
+{
+    int passes = 200;
+    pstring fontfile = "default.ttf";
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-n")) {
+            if (++i == argc) usage();
+            passes = atoi(argv[i]);
+        }
+        else if (argv[i][0] == '-')
+            usage();
+        else
+            fontfile = argv[i];
+    }
+
+    FILE* fp = fopen(fontfile, "rb");
+    if (!fp) {
+        fprintf(stderr, "textbench: can't open %s\n", (const char*) fontfile);
+        return 1;
+    }
+    fclose(fp);
+
+    if (SDL_Init(SDL_INIT_VIDEO) < 0) {
+        fprintf(stderr, "textbench: couldn't initialise SDL: %s\n",
+                SDL_GetError());
+        return 1;
+    }
+
+    file_encoding = new UTF8Encoding;
+    DefaultLigatures(9);
+
+    // The font system looks fonts up by name in a search path.
+    pstring dir = "./", name = fontfile;
+    const char* slash = strrchr(fontfile, '/');
+    if (slash) {
+        dir = fontfile.midstr(0, slash - (const char*) fontfile + 1);
+        name = slash + 1;
+    }
+    DirPaths path(dir);
+    // Faces not found on disk are looked for in archives, as in a game.
+    ScriptHandler::cBR = new DirectReader(&path);
+    InitialiseFontSystem(&path);
+    for (int i = 0; i < 8; ++i) MapFont(i, name);
+
+    pstring text[corpus_lines];
+    for (int i = 0; i < corpus_lines; ++i) text[i] = parseTags(corpus[i]);
+
+    Fontinfo f;
+    f.top_x = f.top_y = 0;
+    f.area_x = 640;
+    f.area_y = 480;
+    f.pitch_x = f.pitch_y = 0;
+    f.clear();
+
+    AnimationInfo layer;
+    layer.num_of_cells = 1;
+    layer.allocImage(f.area_x, f.area_y);
+
+    unsigned long bad = check(f, text);
+    if (bad) {
+        fprintf(stderr, "textbench: %lu glyphs' fills differ with and "
+                "without shadows\n", bad);
+        return 1;
+    }
+
+    // One untimed pass, so faces are loaded and caches are warm.
+    measure(f, text);
+    render(f, layer, text);
+
+    unsigned long calls = 0, allocs = bench_allocations;
+    double start = seconds();
+    for (int i = 0; i < passes; ++i) calls += measure(f, text);
+    double measure_time = seconds() - start;
+    unsigned long measure_allocs = bench_allocations - allocs;
+
+    unsigned long glyphs = 0;
+    allocs = bench_allocations;
+    start = seconds();
+    for (int i = 0; i < passes; ++i) glyphs += render(f, layer, text);
+    double render_time = seconds() - start;
+    unsigned long render_allocs = bench_allocations - allocs;
+
+    printf("font:         %s\n", (const char*) fontfile);
+    printf("passes:       %d\n", passes);
+    printf("measurement:  %lu calls in %.3fs, %.0f calls/sec, "
+           "%lu allocations\n", calls, measure_time,
+           calls / measure_time, measure_allocs);
+    printf("rendering:    %lu glyphs in %.3fs, %.0f glyphs/sec, "
+           "%lu allocations\n", glyphs, render_time,
+           glyphs / render_time, render_allocs);
+
+    layer.deleteImage();
+    SDL_Quit();
+    return 0;
+}
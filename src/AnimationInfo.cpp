@@ -29,6 +29,7 @@
 
 #include "AnimationInfo.h"
 #include "BaseReader.h"
+#include "font.h"
 
 #include "graphics_common.h"
 
@@ -723,6 +724,99 @@ void AnimationInfo::blendText( SDL_Surface *surface, int dst_x, int dst_y,
 }
 
 
+// Composites a glyph and its drop shadow in one pass: at each pixel the
+// shadow is blended first and the fill over it, exactly as if the glyph
+// had been drawn twice.
+void AnimationInfo::blendText(const GlyphShadow& glyph, int dst_x, int dst_y,
+                              SDL_Color &color, SDL_Color &shadow_color,
+                              SDL_Rect *clip)
+{
+    if (image_surface == NULL || glyph.coverage.empty()) return;
+
+    SDL_Rect dst_rect = { dst_x, dst_y, glyph.w, glyph.h };
+    SDL_Rect src_rect = { 0, 0, 0, 0 };
+    SDL_Rect clipped_rect;
+
+    /* ---------------------------------------- */
+    /* 1st clipping */
+    if (clip) {
+        if (doClipping(&dst_rect, clip, &clipped_rect)) return;
+
+        src_rect.x += clipped_rect.x;
+        src_rect.y += clipped_rect.y;
+    }
+
+    /* ---------------------------------------- */
+    /* 2nd clipping */
+    SDL_Rect clip_rect = { 0, 0, image_surface->w, image_surface->h };
+    if (doClipping(&dst_rect, &clip_rect, &clipped_rect)) return;
+
+    src_rect.x += clipped_rect.x;
+    src_rect.y += clipped_rect.y;
+
+    /* ---------------------------------------- */
+
+    SDL_LockSurface(image_surface);
+
+#ifdef BPP16
+    int total_width = image_surface->pitch / 2;
+    Uint32 fill_color = ((color.r >> RLOSS) << RSHIFT) |
+                        ((color.g >> GLOSS) << GSHIFT) |
+                        (color.b >> BLOSS);
+    fill_color = (fill_color | fill_color << 16) & BLENDMASK;
+    Uint32 shade_color = ((shadow_color.r >> RLOSS) << RSHIFT) |
+                         ((shadow_color.g >> GLOSS) << GSHIFT) |
+                         (shadow_color.b >> BLOSS);
+    shade_color = (shade_color | shade_color << 16) & BLENDMASK;
+    Uint32 src_color;
+#else
+    int total_width = image_surface->pitch / 4;
+    const Uint32 fill_color1 = color.r << RSHIFT | color.b;
+    const Uint32 fill_color2 = color.g << GSHIFT;
+    const Uint32 shade_color1 = shadow_color.r << RSHIFT | shadow_color.b;
+    const Uint32 shade_color2 = shadow_color.g << GSHIFT;
+    Uint32 src_color1, src_color2;
+#endif
+    ONSBuf *dst_buffer = (ONSBuf *)image_surface->pixels +
+                         total_width * dst_rect.y +
+                         image_surface->w*current_cell/num_of_cells +
+                         dst_rect.x;
+#ifdef BPP16
+    unsigned char *alphap = alpha_buf + image_surface->w * dst_rect.y +
+                            image_surface->w*current_cell/num_of_cells +
+                            dst_rect.x;
+#endif
+    const unsigned char *coverage = &glyph.coverage[0] +
+                                    2 * (glyph.w * src_rect.y + src_rect.x);
+    for (int i=dst_rect.h; i>0; i--){
+        for (int j=dst_rect.w; j>0; j--, dst_buffer++, coverage += 2){
+            const unsigned char *src_buffer = coverage;
+#ifdef BPP16
+            src_color = shade_color;
+            BLEND_PIXEL8_ALPHA();
+            alphap--;
+            src_color = fill_color;
+#else
+            src_color1 = shade_color1;
+            src_color2 = shade_color2;
+            BLEND_PIXEL8_ALPHA();
+            src_color1 = fill_color1;
+            src_color2 = fill_color2;
+#endif
+            src_buffer++;
+            BLEND_PIXEL8_ALPHA();
+        }
+        dst_buffer += total_width - dst_rect.w;
+#ifdef BPP16
+        alphap += image_surface->w - dst_rect.w;
+#endif
+        coverage += 2 * (glyph.w - dst_rect.w);
+    }
+
+    SDL_UnlockSurface(image_surface);
+}
+
+
 void AnimationInfo::calcAffineMatrix()
 {
     // calculate forward matrix
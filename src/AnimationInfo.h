@@ -52,6 +52,8 @@
 
 #define TRANSBTN_CUTOFF 15 //alpha threshold for ignoring transparent areas
 
+struct GlyphShadow;
+
 class AnimationInfo {
 public:
 #ifdef BPP16
@@ -203,6 +205,9 @@ public:
                          SDL_Rect& clip, int alpha = 256);
     void blendText(SDL_Surface* surface, int dst_x, int dst_y,
                    SDL_Color &color, SDL_Rect* clip, bool rotate_flag=false);
+    void blendText(const GlyphShadow& glyph, int dst_x, int dst_y,
+                   SDL_Color &color, SDL_Color &shadow_color,
+                   SDL_Rect* clip);
     void calcAffineMatrix();
     
     static SDL_Surface* allocSurface(int w, int h);
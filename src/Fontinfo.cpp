@@ -37,9 +37,12 @@ int screen_ratio1 = 1, screen_ratio2 = 1;
 
 int Fontinfo::default_encoding = 0;
 
+static int preloadFonts(void*);
+
 static class FontsStruct {
     friend void MapFont(int, const pstring&);
     friend void MapMetrics(int, const pstring&);
+    friend int preloadFonts(void*);
 
     static const int count = 8;
     bool isinit;
@@ -48,6 +51,31 @@ static class FontsStruct {
     pstring mapping[count];
     pstring metrics[count];
     Font* font_[count];
+
+    enum Source { NotFound, OnDisk, InArchive, Builtin };
+    Source locate(int style, pstring& fpath, pstring& mpath);
+
+    // Faces found on disk are opened ahead of use on a background
+    // thread, so the first appearance of a style doesn't stall on
+    // reading a large font.  font_ belongs to the main thread; the
+    // members below are guarded by lock.  serial[] is bumped whenever a
+    // style is remapped, so stale loads can be discarded.
+    struct Request {
+        int style, serial;
+        pstring fpath, mpath;
+    };
+    SDL_Thread* loader;
+    SDL_mutex* lock;
+    SDL_cond* wake;
+    SDL_cond* done;
+    std::deque<Request> queue;
+    int loading;
+    bool quit;
+    int serial[count];
+    Font* loaded[count];
+
+    void preload(int style);
+    void unqueue(int style);
 public:
     Font* font(int style);
 
@@ -58,22 +86,101 @@ public:
         fallback = "default.ttf";
         for (int i = 0; i < count; ++i) {
             font_[i] = NULL;
+            loaded[i] = NULL;
+            serial[i] = 0;
             mapping[i].format("face%d.ttf", i);
         }
+
+        lock = SDL_CreateMutex();
+        wake = SDL_CreateCond();
+        done = SDL_CreateCond();
+        loading = -1;
+        quit = false;
+        loader = SDL_CreateThread(preloadFonts, "font preload", NULL);
+        for (int i = 0; i < count; ++i) preload(i);
     }
 
-    FontsStruct() : isinit(false) {}
+    FontsStruct() : isinit(false), loader(NULL), lock(NULL) {}
     ~FontsStruct();
 } Fonts;
 
 FontsStruct::~FontsStruct()
 {
+    // The loader itself may get here by way of exit() if a face fails
+    // to open.
+    if (loader && SDL_ThreadID() != SDL_GetThreadID(loader)) {
+        SDL_LockMutex(lock);
+        quit = true;
+        SDL_CondSignal(wake);
+        SDL_UnlockMutex(lock);
+        SDL_WaitThread(loader, NULL);
+        SDL_DestroyCond(done);
+        SDL_DestroyCond(wake);
+        SDL_DestroyMutex(lock);
+    }
     for (int i = 0; i < count; ++i) {
         if (font_[i]) delete font_[i];
+        if (isinit && loaded[i]) delete loaded[i];
     }
     FontFinished();
 }
 
+// Drops any queued or finished preload of a style.  Call with lock held.
+void FontsStruct::unqueue(int style)
+{
+    ++serial[style];
+    for (std::deque<Request>::iterator q = queue.begin(); q != queue.end(); ++q)
+        if (q->style == style) {
+            queue.erase(q);
+            break;
+        }
+    if (loaded[style]) {
+        delete loaded[style];
+        loaded[style] = NULL;
+    }
+}
+
+// Hands a style to the loader thread if it is to come from a plain file.
+void FontsStruct::preload(int style)
+{
+    Request r;
+    if (!loader || locate(style, r.fpath, r.mpath) != OnDisk) return;
+
+    SDL_LockMutex(lock);
+    r.style = style;
+    r.serial = serial[style];
+    queue.push_back(r);
+    SDL_CondSignal(wake);
+    SDL_UnlockMutex(lock);
+}
+
+static int preloadFonts(void*)
+{
+    FontsStruct& f = Fonts;
+    SDL_LockMutex(f.lock);
+    for (;;) {
+        while (f.queue.empty() && !f.quit) SDL_CondWait(f.wake, f.lock);
+        if (f.quit) break;
+
+        FontsStruct::Request r = f.queue.front();
+        f.queue.pop_front();
+        f.loading = r.style;
+        SDL_UnlockMutex(f.lock);
+
+        Font* font = new Font(r.fpath, r.mpath ? (const char*) r.mpath : NULL);
+
+        SDL_LockMutex(f.lock);
+        f.loading = -1;
+        if (r.serial == f.serial[r.style] && !f.loaded[r.style])
+            f.loaded[r.style] = font;
+        else
+            delete font;
+        SDL_CondBroadcast(f.done);
+    }
+    SDL_UnlockMutex(f.lock);
+    return 0;
+}
+
 void InitialiseFontSystem(DirPaths *basepath)
 {
     FontInitialise();
@@ -82,17 +189,73 @@ void InitialiseFontSystem(DirPaths *basepath)
 
 void MapFont(int id, const pstring& filename)
 {
+    SDL_LockMutex(Fonts.lock);
     Fonts.mapping[id] = filename;
+    Fonts.unqueue(id);
+    SDL_UnlockMutex(Fonts.lock);
+
     if (Fonts.font_[id] != NULL) {
         delete Fonts.font_[id];
         Fonts.font_[id] = NULL;
     }
+    Fonts.preload(id);
 }
 
 
 void MapMetrics(int id, const pstring& filename)
 {
+    SDL_LockMutex(Fonts.lock);
     Fonts.metrics[id] = filename;
+    if (Fonts.font_[id] == NULL) Fonts.unqueue(id);
+    SDL_UnlockMutex(Fonts.lock);
+
+    if (Fonts.font_[id] == NULL) Fonts.preload(id);
+}
+
+
+// Works out where font() will find a style's face.  For a file on
+// disk, fpath and mpath are set to it and to its metrics file (if any).
+// A face in the archive is only used if no search path has a file.
+FontsStruct::Source FontsStruct::locate(int style, pstring& fpath,
+                                        pstring& mpath)
+{
+    Source rv = NotFound;
+    FILE* fp;
+
+    for (int n = 0; n < path->get_num_paths(); ++n) {
+        pstring curpath = path->get_path(n);
+        pstring dirs[2] = { curpath, curpath + "fonts" + DELIMITER };
+
+        for (int i = 0; i < 2; ++i) {
+            if ((fp = fopen(dirs[i] + mapping[style], "rb"))) {
+                fclose(fp);
+                fpath = dirs[i] + mapping[style];
+                mpath = "";
+                if (metrics[style] &&
+                    (fp = fopen(dirs[i] + metrics[style], "rb"))) {
+                    fclose(fp);
+                    mpath = dirs[i] + metrics[style];
+                }
+                return OnDisk;
+            }
+        }
+
+        if (ScriptHandler::cBR->getFileLength(mapping[style]))
+            rv = InArchive;
+        else if (getResource(mapping[style]))
+            rv = Builtin;
+
+        // Fall back on default.ttf if no font was specified and
+        // face$STYLE.ttf was not found.
+        if (rv == NotFound && (fp = fopen(curpath + fallback, "rb"))) {
+            fclose(fp);
+            fpath = curpath + fallback;
+            mpath = "";
+            return OnDisk;
+        }
+    }
+
+    return rv;
 }
 
 
@@ -105,73 +268,45 @@ Font* FontsStruct::font(int style)
     
     if (font_[style]) return font_[style];
 
-    size_t len;
-    FILE* fp = NULL;
-    int n=0;
-
-    while ((fp == NULL) && (n<path->get_num_paths())) {
-        pstring curpath = path->get_path(n++);
-
-        pstring fpath = curpath + mapping[style];
-        fp = fopen(fpath, "rb");
-        if (fp) {
-            fclose(fp);
-            pstring mpath;
-            const char* metnam = NULL;
-            if (metrics[style]) {
-                mpath = curpath + metrics[style];
-                fp = fopen(mpath, "rb");
-                if (fp) {
-                    metnam = mpath;
-                    fclose(fp);
-                }
+    // Take the face from the loader if it has it; if it hasn't got to
+    // this style yet, it's quicker to open it here than to wait.
+    SDL_LockMutex(lock);
+    while (loading == style) SDL_CondWait(done, lock);
+    font_[style] = loaded[style];
+    loaded[style] = NULL;
+    unqueue(style);
+    SDL_UnlockMutex(lock);
+
+    if (!font_[style]) {
+        pstring fpath, mpath;
+        switch (locate(style, fpath, mpath)) {
+        case OnDisk:
+            font_[style] = new Font(fpath, mpath ? (const char*) mpath : NULL);
+            break;
+        case InArchive: {
+            size_t len = ScriptHandler::cBR->getFileLength(mapping[style]);
+            Uint8 *data = new Uint8[len], *mdat = NULL;
+            ScriptHandler::cBR->getFile(mapping[style], data);
+            size_t mlen = 0;
+            if (metrics[style] &&
+                (mlen = ScriptHandler::cBR->getFileLength(metrics[style]))) {
+                mdat = new Uint8[mlen];
+                ScriptHandler::cBR->getFile(metrics[style], mdat);
             }
 
-            font_[style] = new Font(fpath, metnam);
+            font_[style] = new Font(data, len, mdat, mlen);
+            break;
         }
-        else {
-            fpath = curpath + "fonts" + DELIMITER + mapping[style];
-            fp = fopen(fpath, "rb");
-            if (fp) {
-                fclose(fp);
-                pstring mpath;
-                const char* metnam = NULL;
-                if (metrics[style]) {
-                    mpath = curpath + "fonts" + DELIMITER + metrics[style];
-                    fp = fopen(mpath, "rb");
-                    if (fp) {
-                        metnam = mpath;
-                        fclose(fp);
-                    }
-                }
-                font_[style] = new Font(fpath, metnam);
-            }
-            else if ((len = ScriptHandler::cBR->getFileLength(mapping[style]))) {
-                Uint8 *data = new Uint8[len], *mdat = NULL;
-                ScriptHandler::cBR->getFile(mapping[style], data);
-                size_t mlen = 0;
-                if (metrics[style] &&
-                    (mlen = ScriptHandler::cBR->getFileLength(metrics[style]))) {
-                    mdat = new Uint8[mlen];
-                    ScriptHandler::cBR->getFile(metrics[style], mdat);
-                }
+        case Builtin: {
+            const InternalResource *fres, *mres = NULL;
+            fres = getResource(mapping[style]);
+            if (metrics[style]) mres = getResource(metrics[style]);
 
-                font_[style] = new Font(data, len, mdat, mlen);
-            }
-            else {
-                const InternalResource *fres, *mres = NULL;
-                fres = getResource(mapping[style]);
-                if (metrics[style]) mres = getResource(metrics[style]);
-
-                if (fres) font_[style] = new Font(fres, mres);
-            }
+            font_[style] = new Font(fres, mres);
+            break;
         }
-
-        // Fall back on default.ttf if no font was specified and
-        // face$STYLE.ttf was not found.
-        if (!font_[style] && (fp = fopen(curpath + fallback, "rb"))) {
-            fclose(fp);
-            font_[style] = new Font(curpath + fallback, (const char*) NULL);
+        case NotFound:
+            break;
         }
     }
 
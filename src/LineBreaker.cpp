@@ -0,0 +1,106 @@
+/* -*- C++ -*-
+ *
+ *  LineBreaker.cpp - Break opportunities and word widths for the
+ *                    Ponscripter line breaker
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+#include "LineBreaker.h"
+#include "Fontinfo.h"
+
+static const wchar start_kinsoku[] = {
+    0x3001, 0x3002, 0x30FB, 0x203C, 0x2047, 0x2048, 0x2049, 0xFF1F,
+    0xFF01, 0x2010, 0x30A0, 0x2013, 0x301C, 0xFF5E, 0x309D, 0x309E,
+    0x30FC, 0x30A1, 0x30A3, 0x30A5, 0x30A7, 0x30A9, 0x30C3, 0x30E3,
+    0x30E5, 0x30E7, 0x30EE, 0x30F5, 0x30F6, 0x3041, 0x3043, 0x3045,
+    0x3047, 0x3049, 0x3063, 0x3083, 0x3085, 0x3087, 0x308E, 0x3095,
+    0x3096, 0x3005, 0x303B, 0xFF5D, 0x3015, 0x3009, 0x300B, 0x300D,
+    0x300F, 0x3011, 0x3019, 0x3017, 0x301F, 0xFF60, 0x00BB, 0x2019,
+    0x201D, 0x002C, 0x0029, 0x005D, 0
+};
+
+static const wchar middle_kinsoku[] = {
+    0x2014, 0x2026, 0x2025, 0x3033, 0x3034, 0x3035, 0
+};
+
+// TODO finish end kinsoku
+static const wchar end_kinsoku[] = {
+    0x300C, 0x300E, 0xFF5B, 0x3014, 0x3008, 0x300A, 0x3010, 0x3018,
+    0x3016, 0x301D, 0x2018, 0x201C, 0xFF5F, 0x00AB, 0
+};
+
+
+const unsigned char* LineBreaker::table()
+{
+    static unsigned char classes[0x10000];
+    static bool init = false;
+    if (!init) {
+        for (const wchar* c = start_kinsoku; *c; ++c)
+            classes[*c] |= StartKinsoku;
+        for (int c = 0x31F0; c <= 0x31FF; ++c)
+            classes[c] |= StartKinsoku;
+        for (const wchar* c = middle_kinsoku; *c; ++c)
+            classes[*c] |= MiddleKinsoku;
+        for (int c = 0xFF10; c <= 0xFF19; ++c)
+            classes[c] |= MiddleKinsoku;
+        for (const wchar* c = end_kinsoku; *c; ++c)
+            classes[*c] |= EndKinsoku;
+        init = true;
+    }
+    return classes;
+}
+
+
+void LineBreaker::restart(const char* l, int offset)
+{
+    if (l != line) {
+        words.clear();
+        line = l;
+    }
+    words.erase(std::lower_bound(words.begin(), words.end(), offset),
+                words.end());
+}
+
+
+void LineBreaker::add(int offset, const Fontinfo& f, float len)
+{
+    Word w;
+    w.offset = offset;
+    w.style = f.style;
+    w.size = f.base_size();
+    w.mod_size = f.mod_size();
+    w.pitch = f.pitch_x;
+    w.len = len;
+    words.push_back(w);
+}
+
+
+bool LineBreaker::find(const char* l, int offset, const Fontinfo& f,
+                       float& len) const
+{
+    if (l != line) return false;
+
+    std::vector<Word>::const_iterator w =
+        std::lower_bound(words.begin(), words.end(), offset);
+    if (w == words.end() || w->offset != offset || w->style != f.style ||
+        w->size != f.base_size() || w->mod_size != f.mod_size() ||
+        w->pitch != f.pitch_x)
+        return false;
+
+    len = w->len;
+    return true;
+}
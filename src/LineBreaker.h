@@ -0,0 +1,77 @@
+/* -*- C++ -*-
+ *
+ *  LineBreaker.h - Break opportunities and word widths for the
+ *                  Ponscripter line breaker
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+#ifndef __LINE_BREAKER_H__
+#define __LINE_BREAKER_H__
+
+#include "defs.h"
+#include "encoding.h"
+
+class Fontinfo;
+
+// The line breaker decides at each break character whether the word
+// that follows it will fit on the current line.  Rather than measure
+// that word afresh every time, the whole of a line of text is measured
+// once, from the first break onwards, and the width of every word is
+// kept here together with the font state it was measured in.
+class LineBreaker {
+public:
+    // Kinsoku shori classes; a character may be in more than one.
+    enum {
+        StartKinsoku  = 1, // may not begin a line
+        MiddleKinsoku = 2, // may not be split from its neighbour
+        EndKinsoku    = 4  // may not end a line
+    };
+    static int kinsoku(wchar ch) { return table()[ch]; }
+
+    LineBreaker() : line(NULL) {}
+
+    void clear() { line = NULL; words.clear(); }
+
+    // Discards any widths for the given line from offset onwards, ready
+    // for it to be measured again from there.
+    void restart(const char* line, int offset);
+
+    // Records the width of the word that starts with the break
+    // character at offset, as measured in font f.
+    void add(int offset, const Fontinfo& f, float len);
+
+    // Looks up the width of the word that starts at offset; fails if it
+    // has not been measured, or was measured in a different font state.
+    bool find(const char* line, int offset, const Fontinfo& f,
+              float& len) const;
+
+private:
+    struct Word {
+        int offset;
+        int style, size, mod_size, pitch;
+        float len;
+
+        bool operator< (int o) const { return offset < o; }
+    };
+
+    const char* line;
+    std::vector<Word> words; // sorted by offset
+
+    static const unsigned char* table();
+};
+
+#endif // __LINE_BREAKER_H__
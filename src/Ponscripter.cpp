@@ -73,6 +73,11 @@ static void optionHelp()
            "acceleration routines\n");
 #endif
     printf("      --record-render-time\tRecord render times to the given csv file\n");
+    printf("      --seek target\tskip from the start to a label or line "
+           "number\n");
+    printf("      --seek-save no\tskip from save slot no instead\n");
+    printf("      --validate-script\treport unknown commands, labels and "
+           "aliases, and exit\n");
     printf("      --enable-wheeldown-advance\tadvance the text on mouse "
            "wheeldown event\n");
 //    printf("      --nsa-offset offset\tuse byte offset x when reading "
@@ -195,6 +200,19 @@ static void parseOptions(int argc, char **argv, PonscripterLabel &ons,
                 argv++;
                 ons.recordRenderTimes(argv[0]);
             }
+            else if (!strcmp(argv[0] + 1, "-seek")) {
+                argc--;
+                argv++;
+                ons.setSeekTarget(argv[0]);
+            }
+            else if (!strcmp(argv[0] + 1, "-seek-save")) {
+                argc--;
+                argv++;
+                ons.setSeekSave(argv[0]);
+            }
+            else if (!strcmp(argv[0] + 1, "-validate-script")) {
+                ons.enableValidation();
+            }
             else if (!strcmp(argv[0] + 1, "-disable-rescale")) {
                 ons.disableRescale();
             }
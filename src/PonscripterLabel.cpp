@@ -145,6 +145,7 @@ sfunc_lut_t::sfunc_lut_t() {
     dict["cselgoto"]         = &PonscripterLabel::cselgotoCommand;
     dict["csp"]              = &PonscripterLabel::cspCommand;
     dict["csp2"]             = &PonscripterLabel::cspCommand;
+    dict["debugseek"]        = &PonscripterLabel::debugseekCommand;
     dict["definereset"]      = &PonscripterLabel::defineresetCommand;
     dict["delay"]            = &PonscripterLabel::delayCommand;
     dict["deletescreenshot"] = &PonscripterLabel::deletescreenshotCommand;
@@ -354,6 +355,18 @@ sfunc_lut_t::sfunc_lut_t() {
     dict["wavestop"]         = &PonscripterLabel::wavestopCommand;
 }
 
+
+// v<n> and dv<n> are voices rather than commands in their own right.
+static PonscrFun lookupCommand(const pstring& cmd)
+{
+    if (cmd[0] == 'v' && cmd[1] >= '0' && cmd[1] <= '9')
+        return &PonscripterLabel::vCommand;
+    if (cmd[0] == 'd' && cmd[1] == 'v' && cmd[2] >= '0' && cmd[2] <= '9')
+        return &PonscripterLabel::dvCommand;
+    return func_lut.get(cmd);
+}
+
+
 static void SDL_Quit_Wrapper()
 {
 #ifdef STEAM
@@ -607,6 +620,13 @@ PonscripterLabel::PonscripterLabel()
     AnimationInfo::gfx = AcceleratedGraphicsFunctions::accelerated();
 
     renderTimesFile      = NULL;
+    effect_frame         = -1;
+    effect_frame_ticks   = SDL_GetPerformanceFrequency() / 60;
+    effect_dropped       = 0;
+    effect_late_ticks    = 0;
+    effect_setup_ticks   = 0;
+    seek_save            = -1;
+    validate_flag        = false;
     disable_rescale_flag = false;
     edit_flag            = false;
     fullscreen_mode      = false;
@@ -732,6 +752,24 @@ void PonscripterLabel::recordRenderTimes(const char* file) {
 }
 
 
+void PonscripterLabel::setSeekTarget(const char* target)
+{
+    seek_target = target;
+}
+
+
+void PonscripterLabel::setSeekSave(const char* no)
+{
+    seek_save = atoi(no);
+}
+
+
+void PonscripterLabel::enableValidation()
+{
+    validate_flag = true;
+}
+
+
 void PonscripterLabel::disableRescale()
 {
     disable_rescale_flag = true;
@@ -1152,6 +1190,7 @@ int PonscripterLabel::init(const char* preferred_script)
     }
 
     if (open(preferred_script)) return -1;
+    if (validate_flag) exit(validateScript() ? 1 : 0);
 
     // Try to determine an appropriate location for saved games.
     if (!script_h.save_path)
@@ -1160,6 +1199,7 @@ int PonscripterLabel::init(const char* preferred_script)
     // If we couldn't find anything obvious, fall back on ONScripter
     // behaviour of putting saved games in the archive path.
     if (!script_h.save_path) script_h.save_path = archive_path.get_path(0);
+    script_h.compileScript();
 
     if (script_h.save_path != archive_path.get_path(0)) {
         // insert save_path onto the front of archive_path
@@ -1272,6 +1312,8 @@ int PonscripterLabel::init(const char* preferred_script)
     trap_dist.trunc(0);
 
     draw_one_page_flag = false;
+    in_fast_forward = false;
+    seek_begin = seek_end = NULL;
 
     for (i = 0; i < MAX_PARAM_NUM; i++)
         bar_info[i] = prnum_info[i] = 0;
@@ -1306,6 +1348,8 @@ void PonscripterLabel::reset()
     if (breakup_cells) delete[] breakup_cells;
     if (breakup_mask) delete[] breakup_mask;
     if (breakup_cellforms) delete[] breakup_cellforms;
+    breakup_cells = NULL;
+    breakup_mask = breakup_cellforms = NULL;
 
     disableGetButtonFlag();
 
@@ -1454,11 +1498,11 @@ void PonscripterLabel::flush(int refresh_mode, SDL_Rect* rect, bool clear_dirty_
                 flushDirect(dirty_rect.bounding_box, refresh_mode);
             }
             else {
+                // The texture is uploaded once, with the last rect.
                 for (int i = 0; i < dirty_rect.num_history; i++) {
-                    flushDirect(dirty_rect.history[i], refresh_mode, false);
+                    flushDirect(dirty_rect.history[i], refresh_mode,
+                                i == dirty_rect.num_history - 1);
                 }
-
-                flushDirect(*rect, refresh_mode);
             }
         }
     }
@@ -1471,9 +1515,22 @@ void PonscripterLabel::flushDirect(SDL_Rect &rect, int refresh_mode, bool update
 {
   refreshSurface(accumulation_surface, &rect, refresh_mode);
 
-  if(!updaterect) return;
+  // The accumulation surface is kept up to date, since effects and
+  // text are drawn on it, but the screen can wait.
+  if (fastForwarding()) {
+    deferred_rect.add(rect);
+    return;
+  }
+
+  if (deferred_rect.area > 0) {
+    SDL_Rect r = deferred_rect.bounding_box;
+    SDL_BlitSurface(accumulation_surface, &r, screen_surface, &r);
+    deferred_rect.clear();
+  }
   SDL_BlitSurface(accumulation_surface, &rect, screen_surface, &rect);
 
+  if(!updaterect) return;
+
   if(SDL_UpdateTexture(screen_tex, NULL, screen_surface->pixels, screen_surface->pitch)) {
     fprintf(stderr,"Error updating texture: %s\n", SDL_GetError());
   }
@@ -1596,6 +1653,155 @@ void PonscripterLabel::mouseOverCheck(int x, int y)
 }
 
 
+void PonscripterLabel::presentDeferred()
+{
+    if (deferred_rect.area == 0) return;
+
+    SDL_Rect r = deferred_rect.bounding_box;
+    SDL_BlitSurface(accumulation_surface, &r, screen_surface, &r);
+    deferred_rect.clear();
+
+    if (SDL_UpdateTexture(screen_tex, NULL, screen_surface->pixels,
+                          screen_surface->pitch))
+        fprintf(stderr, "Error updating texture: %s\n", SDL_GetError());
+}
+
+
+// Runs the script for up to FAST_FORWARD_BATCH ms, as long as it only
+// waits on timers that are already due and draws no effect frames,
+// without going back to the event loop in between.
+void PonscripterLabel::fastForward()
+{
+    Uint32 start = SDL_GetTicks();
+    in_fast_forward = true;
+    while (fastForwarding() && timer_event_flag) {
+        Uint32 now = SDL_GetTicks();
+        if (timer_event_time > now || now - start >= FAST_FORWARD_BATCH)
+            break;
+        timer_event_flag = false;
+        timerEvent();
+
+        // Effects not cut by effectcut play out at the display's pace.
+        if ((event_mode & EFFECT_EVENT_MODE) && effect_frame >= 0) break;
+    }
+    in_fast_forward = false;
+}
+
+
+// Skips from the current position, or from save slot save_no if that
+// is not negative, until the script reaches target: a label, or a
+// line number as given in error messages.
+void PonscripterLabel::startSeek(const pstring& target, int save_no)
+{
+    if (save_no >= 0) {
+        if (loadSaveFile(save_no))
+            fprintf(stderr, "Seek: couldn't load save %d\n", save_no);
+        else if (loadgosub_label)
+            gosubReal(loadgosub_label, script_h.getCurrent());
+    }
+
+    if (target[0] >= '0' && target[0] <= '9') {
+        int line = atoi(target);
+        if (line < 1) line = 1;
+        seek_begin = script_h.getAddressByLine(line - 1);
+        seek_end = script_h.getAddressByLine(line);
+    }
+    else {
+        // The whole label, since it can only be entered at the top.
+        ScriptHandler::LabelInfo label = script_h.lookupLabel(target);
+        seek_begin = label.label_header;
+        seek_end = script_h.getAddressByLine(label.start_line +
+                                             label.num_of_lines);
+    }
+
+    seek_skip_flag = skip_flag;
+    seek_statements = 0;
+    seek_start = SDL_GetPerformanceCounter();
+    skip_flag = true;
+}
+
+
+// Called before each statement while seeking.
+void PonscripterLabel::checkSeek()
+{
+    const char* current = script_h.getCurrent();
+    if (current < seek_begin || current >= seek_end) {
+        // The script may have turned skipping off on the way.
+        skip_flag = true;
+        ++seek_statements;
+        return;
+    }
+
+    double time = (SDL_GetPerformanceCounter() - seek_start) /
+                  double(SDL_GetPerformanceFrequency());
+    printf("Seek: reached line %d after %lu statements in %.3fs, "
+           "%.0f statements/sec\n", script_h.getLineByAddress(current, true),
+           seek_statements, time, time > 0 ? seek_statements / time : 0.0);
+    fflush(stdout);
+
+    skip_flag = seek_skip_flag;
+    seek_begin = seek_end = NULL;
+    dirty_rect.fill(screen_width, screen_height);
+    flush(refreshMode());
+}
+
+
+// Reports every unknown command, missing label and undefined alias
+// in the script, without running it, and returns how many there were.
+// Names are resolved as parseLine() would resolve them, except that
+// every defsub and alias in the script counts as defined everywhere.
+int PonscripterLabel::validateScript()
+{
+    std::vector<ScriptHandler::ScriptRef> refs;
+    script_h.scanScript(refs);
+
+    set<pstring>::t aliases, subs;
+    std::vector<ScriptHandler::ScriptRef>::const_iterator r;
+    for (r = refs.begin(); r != refs.end(); ++r) {
+        if (r->kind == ScriptHandler::ScriptRef::DefineAlias)
+            aliases.insert(r->name);
+        else if (r->kind == ScriptHandler::ScriptRef::DefineSub)
+            subs.insert(r->name);
+    }
+
+    int problems = 0;
+    for (r = refs.begin(); r != refs.end(); ++r) {
+        const char* what = NULL;
+        if (r->kind == ScriptHandler::ScriptRef::Command) {
+            bool orig = r->name[0] == '_';
+            pstring name = orig ? r->name.midstr(1, r->name.length() - 1)
+                                : r->name;
+            if ((orig || subs.find(name) == subs.end()) &&
+                !isParserCommand(name) && !lookupCommand(name))
+                what = "unknown command";
+        }
+        else if (r->kind == ScriptHandler::ScriptRef::Label) {
+            // Or it may be multiplication by an alias.
+            if (!script_h.hasLabel(r->name) &&
+                aliases.find(r->name) == aliases.end())
+                what = "label not found";
+        }
+        else if (r->kind == ScriptHandler::ScriptRef::Alias) {
+            if (aliases.find(r->name) == aliases.end())
+                what = "undefined alias";
+        }
+
+        if (what) {
+            fprintf(stderr, "Script error (line %d): %s \"%s\"\n",
+                    script_h.getLineByAddress(script_h.getAddress(r->offset),
+                                              true),
+                    what, (const char*) r->name);
+            ++problems;
+        }
+    }
+
+    printf("Validated %d names in %d bytes of script: %d problem%s\n",
+           (int) refs.size(), script_h.getScriptBufferLength(), problems,
+           problems == 1 ? "" : "s");
+    return problems;
+}
+
+
 void PonscripterLabel::executeLabel()
 {
     executeLabelTop:
@@ -1659,6 +1865,8 @@ void PonscripterLabel::executeLabel()
             && !script_h.isKidoku())
             setSkipMode(false);
 
+        if (seek_begin) checkSeek();
+
         const char* current = script_h.getCurrent();
         int ret = ScriptParser::parseLine();
         if (ret == RET_NOMATCH) ret = this->parseLine();
@@ -1717,47 +1925,123 @@ bool PonscripterLabel::check_orphan_control()
 }
 
 bool PonscripterLabel::isStartKinsoku(wchar char_val) {
-    return (char_val == 0x3001 || char_val == 0x3002 || char_val == 0x30FB ||
-        char_val == 0x203C || char_val == 0x2047 || char_val == 0x2048 ||
-        char_val == 0x2049 || char_val == 0xFF1F || char_val == 0xFF01 ||
-        char_val == 0x2010 || char_val == 0x30A0 || char_val == 0x2013 ||
-        char_val == 0x301C || char_val == 0xFF5E || char_val == 0x309D ||
-        char_val == 0x309E || char_val == 0x30FC || char_val == 0x30A1 ||
-        char_val == 0x30A3 || char_val == 0x30A5 || char_val == 0x30A7 ||
-        char_val == 0x30A9 || char_val == 0x30C3 || char_val == 0x30E3 ||
-        char_val == 0x30E5 || char_val == 0x30E7 || char_val == 0x30EE ||
-        char_val == 0x30F5 || char_val == 0x30F6 || char_val == 0x3041 ||
-        char_val == 0x3043 || char_val == 0x3045 || char_val == 0x3047 ||
-        char_val == 0x3049 || char_val == 0x3063 || char_val == 0x3083 ||
-        char_val == 0x3085 || char_val == 0x3087 || char_val == 0x308E ||
-        (char_val >= 0x31F0 && char_val <= 0x31FF) ||
-        char_val == 0x3095 || char_val == 0x3096 ||
-        char_val == 0x3005 || char_val == 0x303B || char_val == 0xFF5D ||
-        char_val == 0x3015 || char_val == 0x3009 || char_val == 0x300B ||
-        char_val == 0x300D || char_val == 0x300F || char_val == 0x3011 ||
-        char_val == 0x3019 || char_val == 0x3017 || char_val == 0x301F ||
-        char_val == 0xFF60 || char_val == 0xBB ||
-        char_val == 0x2019 || char_val == 0x201D || char_val == 0x2C ||
-        char_val == 0x29 || char_val == 0x5D);
+    return LineBreaker::kinsoku(char_val) & LineBreaker::StartKinsoku;
 }
 
 bool PonscripterLabel::isMiddleKinsoku(wchar char_val) {
-    return (char_val == 0x2014 || char_val == 0x2026 || char_val == 0x2025 ||
-        char_val == 0x3033 || char_val == 0x3034 || char_val == 0x3035 || 
-        (char_val >= 0xFF10 && char_val <= 0xFF19));
+    return LineBreaker::kinsoku(char_val) & LineBreaker::MiddleKinsoku;
 }
 
-// TODO finish end kinsoku
 bool PonscripterLabel::isEndKinsoku(wchar char_val) {
-    return (char_val == 0x300C || char_val == 0x300E || char_val == 0xFF5B ||
-        char_val == 0x3014 || char_val == 0x3008 || char_val == 0x300A ||
-        char_val == 0x3010 || char_val == 0x3018 || char_val == 0x3016 ||
-        char_val == 0x301D || char_val == 0x2018 || char_val == 0x201C ||
-        char_val == 0xFF5F || char_val == 0xAB);
+    return LineBreaker::kinsoku(char_val) & LineBreaker::EndKinsoku;
+}
+
+// Measures the word beginning with the break character at it, up to
+// the next break character or the end of the text.  On return, it
+// points at the character that ended the word and f is in the state it
+// will be in when that character is reached.
+float PonscripterLabel::measureWord(const char*& it, Fontinfo& f)
+{
+    int l;
+    const wchar first_ch = file_encoding->DecodeWithLigatures(it, f, l);
+    it += l;
+    wchar next_ch = file_encoding->DecodeWithLigatures(it, f, l);
+    float len = f.GlyphAdvance(first_ch, next_ch);
+    while (1) {
+        // For each character (not char!) before a break is found,
+        // get unicode.
+        wchar ch = file_encoding->DecodeWithLigatures(it, f, l);
+  cont: it += l;
+
+        // Check for special sequences.
+        if (ch >= 0x10 && ch < 0x20) {
+            f.processCode(it - l);
+            continue;
+        }
+
+        // Check for token breaks.
+        if (!ch || ch == '\n' || ch == '@' || ch == '\\' || is_break_char(ch)) {
+            it -= l;
+            return len;
+        }
+
+        // Look for an inline command.
+        if (ch == '!' && (*it == 's' || *it == 'd' || *it == 'w')) {
+            // !sd
+            if (it[0] == 's' && it[1] == 'd') {
+                it += 2;
+                continue;
+            }
+            // ![sdw]<int>
+            do { ++it; } while (script_h.isadigit(*it));
+            continue;
+        }
+        else if (ch == '#') {
+            //#rrggbb: check all figures are in order
+            bool ok = true;
+            for (int offs = 1; ok && offs <= 6; ++offs)
+                ok &= script_h.isaxdigit(it[offs]);
+            if (ok) {
+                it += 7; // really 7? or should it be 6?
+                continue;
+            }
+        }
+
+        // No inline command?  Use the glyph metrics, then!
+        next_ch = file_encoding->DecodeWithLigatures(it, f, l);
+        len += f.GlyphAdvance(ch, next_ch);
+        ch = next_ch;
+        goto cont;
+    }
+}
+
+
+// Measures every word from the break character at the current position
+// to the end of the line of text, or the next click wait, recording
+// their widths in line_breaker so that later breaks on the same line
+// need not be measured again.  Returns the width of the first word.
+float PonscripterLabel::measureWords(Fontinfo f)
+{
+    const char* text = script_h.getStrBuf();
+    const char* it = text + string_buffer_offset;
+    line_breaker.restart(script_h.getCurrent(), string_buffer_offset);
+
+    float first_len = 0;
+    for (bool first = true; ; first = false) {
+        const int offset = it - text;
+        const Fontinfo start = f;
+        float len = measureWord(it, f);
+        line_breaker.add(offset, start, len);
+        if (first) first_len = len;
+
+        if (!is_break_char(file_encoding->DecodeWithLigatures(it, f)))
+            return first_len;
+    }
 }
 
+
 int PonscripterLabel::parseLine()
 {
+    int id = script_h.isText() ? -1 : script_h.getCommand();
+    if (id >= 0) {
+        Command& c = command(id);
+        if (c.kind == Command::Other) {
+            PonscrFun f = lookupCommand(c.name);
+            c.fun = static_cast<CommandFun>(f);
+            c.kind = f ? Command::Label : Command::Missing;
+        }
+        if (c.kind == Command::Label) {
+            // Commands end any stretch of text; see below.
+            line_breaker.clear();
+            if (c.orig && (debug_level > 0)) {
+                printf("** executing builtin command '%s' **\n",
+                       (const char*) c.name);
+                fflush(stdout);
+            }
+            return (this->*static_cast<PonscrFun>(c.fun))(c.name);
+        }
+    }
+
     int ret = 0;
     pstring cmd = script_h.getStrBuf();
     bool is_orig_cmd = false;
@@ -1767,6 +2051,9 @@ int PonscripterLabel::parseLine()
     }
 
     if (!script_h.isText()) {
+        // Commands may change fonts or ligatures, and text lines may be
+        // revisited, so widths are only kept for one stretch of text.
+        line_breaker.clear();
 
         if (cmd[0] == 0x0a)
             return RET_CONTINUE;
@@ -1825,54 +2112,10 @@ int PonscripterLabel::parseLine()
                                       f, lf);
 
     if (!isPreTextGoSub && is_break_char(first_ch) && !new_line_skip_flag) {
-        int l;
-        const char* it = script_h.getStrBuf(string_buffer_offset) + lf;
-        wchar next_ch = file_encoding->DecodeWithLigatures(it, f, l);
-        float len = f.GlyphAdvance(first_ch, next_ch);
-        while (1) {
-            // For each character (not char!) before a break is found,
-            // get unicode.
-            wchar ch = file_encoding->DecodeWithLigatures(it, f, l);
-      cont: it += l;
-
-	    // Check for special sequences.
-	    if (ch >= 0x10 && ch < 0x20) {
-		f.processCode(it - l);
-		continue;
-	    }
-
-            // Check for token breaks.
-            if (!ch || ch == '\n' || ch == '@' || ch == '\\' || is_break_char(ch))
-                break;
-
-            // Look for an inline command.
-            if (ch == '!' && (*it == 's' || *it == 'd' || *it == 'w')) {
-                // !sd
-                if (it[0] == 's' && it[1] == 'd') {
-                    it += 2;
-                    continue;
-                }
-                // ![sdw]<int>
-                do { ++it; } while (script_h.isadigit(*it));
-                continue;
-            }
-            else if (ch == '#') {
-                //#rrggbb: check all figures are in order
-                bool ok = true;
-                for (int offs = 1; ok && offs <= 6; ++offs)
-                    ok &= script_h.isaxdigit(it[offs]);
-                if (ok) {
-                    it += 7; // really 7? or should it be 6?
-                    continue;
-                }
-            }
-
-            // No inline command?  Use the glyph metrics, then!
-            next_ch = file_encoding->DecodeWithLigatures(it, f, l);
-            len += f.GlyphAdvance(ch, next_ch);
-            ch = next_ch;
-            goto cont;
-        }
+        float len;
+        if (!line_breaker.find(script_h.getCurrent(), string_buffer_offset,
+                               f, len))
+            len = measureWords(f);
         if (check_orphan_control()) {
             // If this is the start of a sentence, or follows some
             // other punctuation that makes this desirable, we pretend
@@ -29,6 +29,7 @@
 #include "DirPaths.h"
 #include "ScriptParser.h"
 #include "DirtyRect.h"
+#include "LineBreaker.h"
 #include <SDL.h>
 #include <SDL_image.h>
 #include <SDL_mixer.h>
@@ -64,6 +65,9 @@
 
 #define NUM_GLYPH_CACHE 30
 
+// How long the script may run between screen updates while skipping
+#define FAST_FORWARD_BATCH 100 // ms
+
 struct Subtitle {
     int number;
     float time;
@@ -118,6 +122,9 @@ public:
     void enableButtonShortCut();
     void enableWheelDownAdvance();
     void recordRenderTimes(const char* file);
+    void setSeekTarget(const char* target);
+    void setSeekSave(const char* no);
+    void enableValidation();
     void disableCpuGfx();
     void disableRescale();
     void enableEdit();
@@ -141,6 +148,9 @@ public:
     bool key_pressed_flag;
     int  shift_pressed_status;
     int  ctrl_pressed_status;
+    // While skipping, waits and effects take no time, and the script
+    // is run in batches with the screen presented only between them.
+    bool fastForwarding() const { return skip_flag || ctrl_pressed_status; }
 
     /* ---------------------------------------- */
     /* Commands */
@@ -307,6 +317,7 @@ public:
     int delayCommand(const pstring& cmd);
     int deletescreenshotCommand(const pstring& cmd);
     int defineresetCommand(const pstring& cmd);
+    int debugseekCommand(const pstring& cmd);
     int cspCommand(const pstring& cmd);
     int cselgotoCommand(const pstring& cmd);
     int cselbtnCommand(const pstring& cmd);
@@ -422,6 +433,9 @@ private:
     pstring getret_str;
     int    getret_int;
     FILE*  renderTimesFile;
+    pstring seek_target; // for QA: where to fast-forward to on startup
+    int    seek_save;
+    bool   validate_flag; // check the script and exit, rather than run it
     bool   enable_wheeldown_advance_flag;
     bool   disable_rescale_flag;
     bool   edit_flag;
@@ -719,21 +733,65 @@ private:
     bool is_break_char(const wchar c) const
         { return break_chars.find(c) != break_chars.end(); }
     bool check_orphan_control();
+    LineBreaker line_breaker;
+    float measureWord(const char*& it, Fontinfo& f);
+    float measureWords(Fontinfo f);
 
     /* ---------------------------------------- */
     /* Effect related variables */
+    friend class EffectBench; // bench/effectbench.cpp drives effects itself
     DirtyRect dirty_rect, dirty_rect_tmp; // only this region is updated
     int effect_counter; // counter in each effect
     int effect_timer_resolution;
-    int effect_start_time;
-    int effect_start_time_old;
+    // Effects are clocked in frames of the display's refresh interval,
+    // in performance counter ticks from the first frame drawn.
+    Uint64 effect_origin, effect_frame_ticks, effect_lost_ticks;
+    int effect_frame;
+    // Frames skipped, time past their refresh that frames were
+    // finished, and time spent compositing for setEffect(), since last
+    // written to the render times file.
+    int effect_dropped;
+    Uint64 effect_late_ticks, effect_setup_ticks;
 
     int setEffect(Effect& effect, bool generate_effect_dst,
                   bool update_backup_surface);
     int doEffect(Effect& effect, bool clear_dirty_region=true);
     void drawEffect(SDL_Rect* dst_rect, SDL_Rect* src_rect,
                     SDL_Surface* surface);
+    // Shutters, curtains and scrolls are only copies of rectangles, so
+    // a frame's are listed and then copied together a row at a time.
+    struct EffectCopy {
+        SDL_Surface* surface;
+        SDL_Rect dst;
+        int src_x, src_y;
+    };
+    std::vector<EffectCopy> effect_copies;
+    void queueEffect(SDL_Rect* dst_rect, SDL_Rect* src_rect,
+                     SDL_Surface* surface);
+    void drawQueuedEffects();
     void generateMosaic(SDL_Surface* src_surface, int level);
+    // Cells are squares of 160 >> level pixels laid from the bottom
+    // left.  Their average colours at every level, bottom row first,
+    // are found once for mosaic_source and kept for the effect.
+    enum { MOSAIC_LEVELS = 6 };
+    SDL_Surface* mosaic_source;
+    std::vector<ONSBuf> mosaic_cells[MOSAIC_LEVELS];
+    void buildMosaic(SDL_Surface* src_surface);
+
+    // Effects 15 and 18 weight each pixel by how far the fade has got
+    // past its level in the mask.  The rect is kept as runs of pixels
+    // of equal level, bucketed by level, so that each frame redraws
+    // only the levels whose weight has changed since the last.
+    struct MaskSpan { int offset, length; }; // offset in pixels
+    std::vector<MaskSpan> mask_spans;
+    int mask_level_start[257]; // level k's spans are [start[k], start[k+1])
+    int mask_level_pixels[256];
+    SDL_Rect mask_rect;
+    bool mask_accelerated; // blended by AnimationInfo::gfx
+    int mask_drawn; // mask value of the last frame drawn, or -1
+    void initMaskFade(SDL_Surface* mask_surface);
+    void maskFade(SDL_Surface* mask_surface, int trans_mode,
+                  Uint32 mask_value);
 
     enum {
         //some constants for trig tables
@@ -741,12 +799,15 @@ private:
         TRIG_FACTOR  = 16384
     };
     int *sin_table, *cos_table;
-    int *whirl_table;
+    int *whirl_table; // radius of each pixel, in quarter pixels
+    // The rotation at each radius in whirl_table, for this frame.
+    std::vector<int> whirl_cos, whirl_sin;
 
     int effect_tmp; //tmp variable for use by effect routines
     void buildSinTable();
     void buildCosTable();
     void buildWhirlTable();
+    static void whirlRows(void* job, int begin, int end);
     void doFlushout( int level );
     void effectCascade( char *params, int duration );
     void effectTrvswave( char *params, int duration );
@@ -758,14 +819,25 @@ private:
         int dir;
         int state;
         int radius;
+        bool settled; // drawn into the background layer
         BreakupCell()
         : cell_x(0), cell_y(0),
-          dir(0), state(0), radius(0)
+          dir(0), state(0), radius(0), settled(false)
         {}
     } *breakup_cells;
     bool *breakup_cellforms, *breakup_mask;
+    // Cells are drawn a row span at a time.  Each row of a cellform is
+    // a single span; a row of the mask within a cell may be several.
+    struct BreakupSpan { int x0, x1; };
+    std::vector<BreakupSpan> breakup_form_spans;
+    std::vector<BreakupSpan> breakup_mask_spans;
+    std::vector<int> breakup_mask_rows; // first span of each cell row
+    std::vector<int> breakup_cell_at; // cell on each grid square, or -1
+    std::vector<int> breakup_touched;
     void buildBreakupCellforms();
     void buildBreakupMask();
+    void drawBreakupCell(int n, int form, int dx, int dy,
+                         SDL_Surface* src, SDL_Surface* dst);
     void initBreakup( char *params );
     void effectBreakup( char *params, int duration );
 
@@ -876,6 +948,23 @@ private:
     void flush(int refresh_mode, SDL_Rect* rect = 0,
                bool clear_dirty_flag = true, bool direct_flag = false);
     void flushDirect(SDL_Rect &rect, int refresh_mode, bool updaterect = true);
+    // Composited while fast-forwarding, but not yet on the screen.
+    DirtyRect deferred_rect;
+    bool in_fast_forward;
+    void fastForward();
+    void presentDeferred();
+
+    // Seeking skips through the script until a statement within
+    // [seek_begin, seek_end) is reached.
+    const char* seek_begin;
+    const char* seek_end;
+    bool seek_skip_flag; // to restore when the target is reached
+    unsigned long seek_statements;
+    Uint64 seek_start;
+    void startSeek(const pstring& target, int save_no);
+    void checkSeek();
+
+    int validateScript();
 
     void executeLabel();
     int parseLine();
@@ -919,9 +1008,13 @@ private:
                         Uint32 mask_value = 255, SDL_Rect *clip=NULL,
                         SDL_Surface *src1=NULL, SDL_Surface *src2=NULL,
                         SDL_Surface *dst=NULL);
+    static void alphaMaskBlendRows(void* job, int begin, int end);
     void alphaBlendText(SDL_Surface *dst_surface, SDL_Rect dst_rect,
                         SDL_Surface *txt_surface, SDL_Color &color,
                         SDL_Rect *clip, bool rotate_flag);
+    void alphaBlendText(SDL_Surface *dst_surface, SDL_Rect dst_rect,
+                        const GlyphShadow &glyph, SDL_Color &color,
+                        SDL_Color &shadow_color, SDL_Rect *clip);
     void makeNegaSurface(SDL_Surface* surface, SDL_Rect &clip);
     void makeMonochromeSurface(SDL_Surface* surface, SDL_Rect &clip);
     void refreshSurface(SDL_Surface* surface, SDL_Rect* clip_src,
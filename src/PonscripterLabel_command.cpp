@@ -97,7 +97,8 @@ int PonscripterLabel::wavestopCommand(const pstring& cmd)
 
 int PonscripterLabel::waittimerCommand(const pstring& cmd)
 {
-    startTimer(script_h.readIntValue() + internal_timer - SDL_GetTicks());
+    int t = script_h.readIntValue() + internal_timer - SDL_GetTicks();
+    startTimer(fastForwarding() ? 0 : t);
     return RET_WAIT;
 }
 
@@ -105,7 +106,10 @@ int PonscripterLabel::waittimerCommand(const pstring& cmd)
 int PonscripterLabel::waitCommand(const pstring& cmd)
 {
     int count = script_h.readIntValue();
-    if (skip_flag || draw_one_page_flag || ctrl_pressed_status) {
+    if (fastForwarding()) {
+        count = 0;
+    }
+    else if (draw_one_page_flag) {
         //Mion: instead of skipping entirely, let's do a shortened wait (safer)
         if (count > 100) {
             count = count / 10;
@@ -1381,6 +1385,7 @@ int PonscripterLabel::playCommand(const pstring& cmd)
 
 int PonscripterLabel::ofscopyCommand(const pstring& cmd)
 {
+    presentDeferred();
   fprintf(stderr, "Non-upgraded command, help\n");
     SDL_BlitSurface(screen_surface, NULL, accumulation_surface, NULL);
 
@@ -2320,6 +2325,7 @@ int PonscripterLabel::getsevolCommand(const pstring& cmd)
 
 int PonscripterLabel::getscreenshotCommand(const pstring& cmd)
 {
+    presentDeferred();
     int w = script_h.readIntValue();
     int h = script_h.readIntValue();
     if (w == 0) w = 1;
@@ -2578,6 +2584,11 @@ int PonscripterLabel::gameCommand(const pstring& cmd)
     setCurrentLabel("start");
     saveSaveFile(-1);
 
+    if (seek_target.length()) {
+        startSeek(seek_target, seek_save);
+        seek_target = "";
+    }
+
     return RET_CONTINUE;
 }
 
@@ -2934,6 +2945,24 @@ int PonscripterLabel::defineresetCommand(const pstring& cmd)
 }
 
 
+// debugseek target[, save_no]: restarts from *start, or from the
+// given save, and skips to target, for testing.
+int PonscripterLabel::debugseekCommand(const pstring& cmd)
+{
+    pstring target = script_h.readStrValue();
+    int save_no = script_h.hasMoreArgs() ? script_h.readIntValue() : -1;
+
+    resetSub();
+    clearAllCurrentTextBuffers();
+    string_buffer_offset = 0;
+
+    setCurrentLabel("start");
+    startSeek(target, save_no);
+
+    return RET_CONTINUE;
+}
+
+
 int PonscripterLabel::cspCommand(const pstring& cmd)
 {
     int ret = leaveTextDisplayMode();
@@ -3373,6 +3402,7 @@ int PonscripterLabel::brCommand(const pstring& cmd)
 
 int PonscripterLabel::bltCommand(const pstring& cmd)
 {
+    presentDeferred();
   fprintf(stderr, "bltCommand used, but not updated to SDL2 properly\n");
     int dx, dy, dw, dh;
     int sx, sy, sw, sh;
@@ -3464,6 +3494,7 @@ int PonscripterLabel::bltCommand(const pstring& cmd)
 
 int PonscripterLabel::endrollCommand(const pstring& cmd)
 {
+    presentDeferred();
     int dx, dy, dw, dh;
     int sx, sy, sw, sh;
     int interval, dist, count, multiplier = 2, timecounter = 0, amountcounter = 0;
@@ -3618,6 +3649,7 @@ int PonscripterLabel::bidirectCommand(const pstring& cmd)
 
 int PonscripterLabel::bgcopyCommand(const pstring& cmd)
 {
+    presentDeferred();
     SDL_BlitSurface(screen_surface, NULL, accumulation_surface, NULL);
     fprintf(stderr, "Likely partially-updated command used bgcopyCommand\n");
 
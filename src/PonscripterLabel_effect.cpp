@@ -35,6 +35,7 @@ int PonscripterLabel::setEffect(Effect& effect, bool generate_effect_dst, bool u
 {
     if (effect.effect == 0) return RET_CONTINUE;
 
+    Uint64 setup_start = SDL_GetPerformanceCounter();
     if (update_backup_surface)
         refreshSurface(backup_surface, &dirty_rect.bounding_box,
                        REFRESH_NORMAL_MODE);
@@ -51,7 +52,13 @@ int PonscripterLabel::setEffect(Effect& effect, bool generate_effect_dst, bool u
                             effect_dst_surface, &dirty_rect.bounding_box);
         }
         else {
-            if (effect_no == 1)
+            // Scrolls, mosaics and DLL effects draw on all of the new
+            // image; the rest never look outside the dirty region, so
+            // that is all that need be composited before they start.
+            bool whole = (effect_no >= 11 && effect_no <= 14) ||
+                         effect_no == 16 || effect_no == 17 ||
+                         effect_no == 99;
+            if (!whole)
                 refreshSurface(effect_dst_surface, &dirty_rect.bounding_box,
                                refresh_mode);
             else
@@ -65,6 +72,7 @@ int PonscripterLabel::setEffect(Effect& effect, bool generate_effect_dst, bool u
             parseTaggedString(&effect.anim, true);
             setupAnimationInfo(&effect.anim);
         }
+        initMaskFade(effect.anim.image_surface);
     }
     if (effect_no == 11 || effect_no == 12 || effect_no == 13 ||
         effect_no == 14 || effect_no == 16 || effect_no == 17)
@@ -101,10 +109,19 @@ int PonscripterLabel::setEffect(Effect& effect, bool generate_effect_dst, bool u
         }
     }
 
+    // The refresh interval as exactly as the display reports it.
+    SDL_DisplayMode mode;
+    int rate = 60;
+    if (SDL_GetWindowDisplayMode(screen, &mode) == 0 && mode.refresh_rate > 0)
+        rate = mode.refresh_rate;
+    effect_frame_ticks = SDL_GetPerformanceFrequency() / rate;
+
+    mosaic_source = NULL;
     effect_counter = 0;
-    effect_start_time_old = SDL_GetTicks();
+    effect_frame = -1;
     event_mode = EFFECT_EVENT_MODE;
     advancePhase();
+    effect_setup_ticks += SDL_GetPerformanceCounter() - setup_start;
 
     return RET_WAIT | RET_REREAD;
 }
@@ -114,18 +131,55 @@ int PonscripterLabel::doEffect(Effect& effect, bool clear_dirty_region)
 {
     if (lastRenderEvent < RENDER_EVENT_EFFECT) { lastRenderEvent = RENDER_EVENT_EFFECT; }
 
-    bool first_time = (effect_counter == 0);
+    bool first_time = (effect_frame < 0);
+
+    // Each frame is drawn as of the refresh it will be shown at, taken
+    // from the performance counter, so the effect's progress doesn't
+    // jitter with when the event loop gets round to drawing it.
+    const Uint64 freq = SDL_GetPerformanceFrequency();
+    const Uint64 now = SDL_GetPerformanceCounter();
+    if (first_time) {
+        effect_origin = now;
+        effect_frame = 0;
+        effect_lost_ticks = 0;
+    }
+    else {
+        // The next refresh, so the frame's deadline is still ahead.
+        int frame = int((now - effect_origin + effect_frame_ticks - 1) /
+                        effect_frame_ticks);
+
+        // Called again before the next refresh, there is nothing new to
+        // show; drawing it anyway would run the effect ahead of time.
+        if (frame <= effect_frame && !(ctrl_pressed_status || skip_to_wait))
+            return RET_WAIT | RET_REREAD;
+        if (frame <= effect_frame) frame = effect_frame;
+        effect_dropped += std::max(0, frame - effect_frame - 1);
+        effect_frame = frame;
+
+        Uint64 t = Uint64(frame) * effect_frame_ticks - effect_lost_ticks;
+        effect_timer_resolution = int(t * 1000 / freq) - effect_counter;
+
+        // Quakes go no more than a quarter wave a frame; time lost to
+        // that is not made up later.
+        if (effect.effect == CUSTOM_EFFECT_NO + 0 ||
+            effect.effect == CUSTOM_EFFECT_NO + 1) {
+            int step = std::max(1, effect.duration / 4 / effect.no);
+            if (effect_timer_resolution > step) {
+                effect_lost_ticks +=
+                    Uint64(effect_timer_resolution - step) * freq / 1000;
+                effect_timer_resolution = step;
+            }
+        }
+        effect_counter += effect_timer_resolution;
+        if (effect_counter > effect.duration)
+            effect_counter = effect.duration;
+    }
 
     int prevduration = effect.duration;
     if (ctrl_pressed_status || skip_to_wait) {
         effect.duration = effect_counter = 1;
     }
 
-    effect_start_time = SDL_GetTicks();
-
-    effect_timer_resolution = effect_start_time - effect_start_time_old;
-    effect_start_time_old = effect_start_time;
-
     int effect_no = effect.effect;
     if (effect_cut_flag && skip_flag) effect_no = 1;
 
@@ -152,7 +206,7 @@ int PonscripterLabel::doEffect(Effect& effect, bool clear_dirty_region)
             src_rect.y = 0;
             src_rect.w = width;
             src_rect.h = screen_height;
-            drawEffect(&src_rect, &src_rect, effect_dst_surface);
+            queueEffect(&src_rect, &src_rect, effect_dst_surface);
         }
 
         break;
@@ -164,7 +218,7 @@ int PonscripterLabel::doEffect(Effect& effect, bool clear_dirty_region)
             src_rect.y = 0;
             src_rect.w = width;
             src_rect.h = screen_height;
-            drawEffect(&src_rect, &src_rect, effect_dst_surface);
+            queueEffect(&src_rect, &src_rect, effect_dst_surface);
         }
 
         break;
@@ -176,7 +230,7 @@ int PonscripterLabel::doEffect(Effect& effect, bool clear_dirty_region)
             src_rect.y = i * EFFECT_STRIPE_WIDTH;
             src_rect.w = screen_width;
             src_rect.h = height;
-            drawEffect(&src_rect, &src_rect, effect_dst_surface);
+            queueEffect(&src_rect, &src_rect, effect_dst_surface);
         }
 
         break;
@@ -188,7 +242,7 @@ int PonscripterLabel::doEffect(Effect& effect, bool clear_dirty_region)
             src_rect.y = i * EFFECT_STRIPE_WIDTH - height - 1;
             src_rect.w = screen_width;
             src_rect.h = height;
-            drawEffect(&src_rect, &src_rect, effect_dst_surface);
+            queueEffect(&src_rect, &src_rect, effect_dst_surface);
         }
 
         break;
@@ -202,7 +256,7 @@ int PonscripterLabel::doEffect(Effect& effect, bool clear_dirty_region)
                 src_rect.y = 0;
                 src_rect.w = width2;
                 src_rect.h = screen_height;
-                drawEffect(&src_rect, &src_rect, effect_dst_surface);
+                queueEffect(&src_rect, &src_rect, effect_dst_surface);
             }
         }
 
@@ -219,7 +273,7 @@ int PonscripterLabel::doEffect(Effect& effect, bool clear_dirty_region)
                 src_rect.y = 0;
                 src_rect.w = width2;
                 src_rect.h = screen_height;
-                drawEffect(&src_rect, &src_rect, effect_dst_surface);
+                queueEffect(&src_rect, &src_rect, effect_dst_surface);
             }
         }
 
@@ -234,7 +288,7 @@ int PonscripterLabel::doEffect(Effect& effect, bool clear_dirty_region)
                 src_rect.y = i * EFFECT_STRIPE_CURTAIN_WIDTH;
                 src_rect.w = screen_width;
                 src_rect.h = height2;
-                drawEffect(&src_rect, &src_rect, effect_dst_surface);
+                queueEffect(&src_rect, &src_rect, effect_dst_surface);
             }
         }
 
@@ -249,7 +303,7 @@ int PonscripterLabel::doEffect(Effect& effect, bool clear_dirty_region)
                 src_rect.y = screen_height - i * EFFECT_STRIPE_CURTAIN_WIDTH - height2;
                 src_rect.w = screen_width;
                 src_rect.h = height2;
-                drawEffect(&src_rect, &src_rect, effect_dst_surface);
+                queueEffect(&src_rect, &src_rect, effect_dst_surface);
             }
         }
 
@@ -299,14 +353,14 @@ int PonscripterLabel::doEffect(Effect& effect, bool clear_dirty_region)
         src_rect.y = dst_rect.y = 0;
         src_rect.w = dst_rect.w = screen_width - width;
         src_rect.h = dst_rect.h = screen_height;
-        drawEffect(&dst_rect, &src_rect, effect_src_surface);
+        queueEffect(&dst_rect, &src_rect, effect_src_surface);
 
         src_rect.x = screen_width - width - 1;
         dst_rect.x = 0;
         src_rect.y = dst_rect.y = 0;
         src_rect.w = dst_rect.w = width;
         src_rect.h = dst_rect.h = screen_height;
-        drawEffect(&dst_rect, &src_rect, effect_dst_surface);
+        queueEffect(&dst_rect, &src_rect, effect_dst_surface);
         break;
 
     case 12: // Right scroll
@@ -316,14 +370,14 @@ int PonscripterLabel::doEffect(Effect& effect, bool clear_dirty_region)
         src_rect.y = dst_rect.y = 0;
         src_rect.w = dst_rect.w = screen_width - width;
         src_rect.h = dst_rect.h = screen_height;
-        drawEffect(&dst_rect, &src_rect, effect_src_surface);
+        queueEffect(&dst_rect, &src_rect, effect_src_surface);
 
         src_rect.x = 0;
         dst_rect.x = screen_width - width - 1;
         src_rect.y = dst_rect.y = 0;
         src_rect.w = dst_rect.w = width;
         src_rect.h = dst_rect.h = screen_height;
-        drawEffect(&dst_rect, &src_rect, effect_dst_surface);
+        queueEffect(&dst_rect, &src_rect, effect_dst_surface);
         break;
 
     case 13: // Top scroll
@@ -333,14 +387,14 @@ int PonscripterLabel::doEffect(Effect& effect, bool clear_dirty_region)
         dst_rect.y = width;
         src_rect.w = dst_rect.w = screen_width;
         src_rect.h = dst_rect.h = screen_height - width;
-        drawEffect(&dst_rect, &src_rect, effect_src_surface);
+        queueEffect(&dst_rect, &src_rect, effect_src_surface);
 
         src_rect.x = dst_rect.x = 0;
         src_rect.y = screen_height - width - 1;
         dst_rect.y = 0;
         src_rect.w = dst_rect.w = screen_width;
         src_rect.h = dst_rect.h = width;
-        drawEffect(&dst_rect, &src_rect, effect_dst_surface);
+        queueEffect(&dst_rect, &src_rect, effect_dst_surface);
         break;
 
     case 14: // Bottom scroll
@@ -350,18 +404,18 @@ int PonscripterLabel::doEffect(Effect& effect, bool clear_dirty_region)
         dst_rect.y = 0;
         src_rect.w = dst_rect.w = screen_width;
         src_rect.h = dst_rect.h = screen_height - width;
-        drawEffect(&dst_rect, &src_rect, effect_src_surface);
+        queueEffect(&dst_rect, &src_rect, effect_src_surface);
 
         src_rect.x = dst_rect.x = 0;
         src_rect.y = 0;
         dst_rect.y = screen_height - width - 1;
         src_rect.w = dst_rect.w = screen_width;
         src_rect.h = dst_rect.h = width;
-        drawEffect(&dst_rect, &src_rect, effect_dst_surface);
+        queueEffect(&dst_rect, &src_rect, effect_dst_surface);
         break;
 
     case 15: // Fade with mask
-        alphaMaskBlend(effect.anim.image_surface, ALPHA_BLEND_FADE_MASK, 256 * effect_counter / effect.duration, &dirty_rect.bounding_box);
+        maskFade(effect.anim.image_surface, ALPHA_BLEND_FADE_MASK, 256 * effect_counter / effect.duration);
         break;
 
     case 16: // Mosaic out
@@ -373,13 +427,10 @@ int PonscripterLabel::doEffect(Effect& effect, bool clear_dirty_region)
         break;
 
     case 18: // Cross fade with mask
-        alphaMaskBlend(effect.anim.image_surface, ALPHA_BLEND_CROSSFADE_MASK, 256 * effect_counter * 2 / effect.duration, &dirty_rect.bounding_box);
+        maskFade(effect.anim.image_surface, ALPHA_BLEND_CROSSFADE_MASK, 256 * effect_counter * 2 / effect.duration);
         break;
 
     case (CUSTOM_EFFECT_NO + 0): // quakey
-        if (effect_timer_resolution > effect.duration / 4 / effect.no)
-            effect_timer_resolution = effect.duration / 4 / effect.no;
-
         dst_rect.x = 0;
         dst_rect.y = (Sint16) (sin(M_PI * 2.0 * effect.no * effect_counter / effect.duration) *
                                EFFECT_QUAKE_AMP * effect.no * (effect.duration - effect_counter) / effect.duration);
@@ -388,9 +439,6 @@ int PonscripterLabel::doEffect(Effect& effect, bool clear_dirty_region)
         break;
 
     case (CUSTOM_EFFECT_NO + 1): // quakex
-        if (effect_timer_resolution > effect.duration / 4 / effect.no)
-            effect_timer_resolution = effect.duration / 4 / effect.no;
-
         dst_rect.x = (Sint16) (sin(M_PI * 2.0 * effect.no * effect_counter / effect.duration) *
                                EFFECT_QUAKE_AMP * effect.no * (effect.duration - effect_counter) / effect.duration);
         dst_rect.y = 0;
@@ -405,12 +453,20 @@ int PonscripterLabel::doEffect(Effect& effect, bool clear_dirty_region)
         break;
     }
 
+    if (!effect_copies.empty()) drawQueuedEffects();
+
     //printf("effect conut %d / dur %d\n", effect_counter, effect.duration);
 
-    effect_counter += effect_timer_resolution;
     if (effect_counter < effect.duration && effect_no != 1) {
         if (effect_no)
             flush(REFRESH_NONE_MODE, NULL, false);
+
+        // Finished after its refresh, this frame has missed it.
+        Uint64 deadline = effect_origin + Uint64(effect_frame) *
+                          effect_frame_ticks;
+        Uint64 done = SDL_GetPerformanceCounter();
+        if (done > deadline) effect_late_ticks += done - deadline;
+
         effect.duration = prevduration;
         return RET_WAIT | RET_REREAD;
     }
@@ -447,42 +503,179 @@ void PonscripterLabel::drawEffect(SDL_Rect* dst_rect, SDL_Rect* src_rect, SDL_Su
 }
 
 
-void PonscripterLabel::generateMosaic(SDL_Surface* src_surface, int level)
+// Lists a copy as drawEffect() would blit it, clipped to the dirty
+// region and then, as SDL would, to the surfaces.
+void PonscripterLabel::queueEffect(SDL_Rect* dst_rect, SDL_Rect* src_rect, SDL_Surface* surface)
 {
-    int i, j, ii, jj;
-    int width = 160;
-    for (i = 0; i < level; i++) width >>= 1;
+    SDL_Rect dst = *dst_rect, clipped_rect;
+    if (AnimationInfo::doClipping(&dst, &dirty_rect.bounding_box, &clipped_rect)) return;
+
+    int src_x = src_rect->x, src_y = src_rect->y;
+    if (src_rect != dst_rect) {
+        src_x += clipped_rect.x;
+        src_y += clipped_rect.y;
+    }
+    else {
+        src_x = dst.x;
+        src_y = dst.y;
+    }
+
+    if (src_x < 0) { dst.x -= src_x; dst.w += src_x; src_x = 0; }
+    if (src_y < 0) { dst.y -= src_y; dst.h += src_y; src_y = 0; }
+    if (src_x + dst.w > surface->w) dst.w = surface->w - src_x;
+    if (src_y + dst.h > surface->h) dst.h = surface->h - src_y;
+    if (dst.x < 0) { src_x -= dst.x; dst.w += dst.x; dst.x = 0; }
+    if (dst.y < 0) { src_y -= dst.y; dst.h += dst.y; dst.y = 0; }
+    if (dst.x + dst.w > accumulation_surface->w)
+        dst.w = accumulation_surface->w - dst.x;
+    if (dst.y + dst.h > accumulation_surface->h)
+        dst.h = accumulation_surface->h - dst.y;
+    if (dst.w <= 0 || dst.h <= 0) return;
+
+    EffectCopy c;
+    c.surface = surface;
+    c.dst = dst;
+    c.src_x = src_x;
+    c.src_y = src_y;
+    effect_copies.push_back(c);
+}
 
+
+void PonscripterLabel::drawQueuedEffects()
+{
+    SDL_LockSurface(effect_src_surface);
+    SDL_LockSurface(effect_dst_surface);
+    SDL_LockSurface(accumulation_surface);
+    const int dst_pitch = accumulation_surface->pitch;
+    for (size_t i = 0; i < effect_copies.size(); ++i) {
+        const EffectCopy& c = effect_copies[i];
+        const int src_pitch = c.surface->pitch;
+        const char* src = (const char*) c.surface->pixels +
+                          src_pitch * c.src_y + c.src_x * sizeof(ONSBuf);
+        char* dst = (char*) accumulation_surface->pixels +
+                    dst_pitch * c.dst.y + c.dst.x * sizeof(ONSBuf);
+        const size_t bytes = c.dst.w * sizeof(ONSBuf);
+        for (int y = c.dst.h; y; --y) {
+            memcpy(dst, src, bytes);
+            src += src_pitch;
+            dst += dst_pitch;
+        }
+    }
+    SDL_UnlockSurface(accumulation_surface);
+    SDL_UnlockSurface(effect_dst_surface);
+    SDL_UnlockSurface(effect_src_surface);
+    effect_copies.clear();
+}
+
+
+// Pixels are averaged a field at a time.
 #ifdef BPP16
-    int total_width = accumulation_surface->pitch / 2;
+static const int mosaic_shift[4] = { 11, 5, 0, 0 };
+static const Uint32 mosaic_mask[4] = { 0x1f, 0x3f, 0x1f, 0 };
 #else
-    int total_width = accumulation_surface->pitch / 4;
+static const int mosaic_shift[4] = { 24, 16, 8, 0 };
+static const Uint32 mosaic_mask[4] = { 0xff, 0xff, 0xff, 0xff };
 #endif
+
+struct MosaicSum {
+    Uint32 field[4], pixels;
+};
+
+void PonscripterLabel::buildMosaic(SDL_Surface* src_surface)
+{
+    // Sums over the finest cells first, a row at a time...
+    int size = 160 >> (MOSAIC_LEVELS - 1);
+    int cols = (screen_width + size - 1) / size;
+    int rows = (screen_height + size - 1) / size;
+    std::vector<MosaicSum> sums(cols * rows);
+    memset(&sums[0], 0, sums.size() * sizeof(MosaicSum));
+
     SDL_LockSurface(src_surface);
-    SDL_LockSurface(accumulation_surface);
-    ONSBuf* src_buffer = (ONSBuf*) src_surface->pixels;
+    for (int y = 0; y < screen_height; ++y) {
+        const ONSBuf* src = (const ONSBuf*) ((const char*) src_surface->pixels +
+                                             src_surface->pitch * y);
+        MosaicSum* cell = &sums[(screen_height - 1 - y) / size * cols];
+        for (int x = 0; x < screen_width; x += size, ++cell) {
+            int end = std::min(x + size, int(screen_width));
+            for (int k = 0; k < 4; ++k) {
+                Uint32 sum = 0;
+                for (int i = x; i < end; ++i)
+                    sum += src[i] >> mosaic_shift[k] & mosaic_mask[k];
+                cell->field[k] += sum;
+            }
+            cell->pixels += end - x;
+        }
+    }
+    SDL_UnlockSurface(src_surface);
 
-    for (i = screen_height - 1; i >= 0; i -= width) {
-        for (j = 0; j < screen_width; j += width) {
-            ONSBuf  p = src_buffer[i * total_width + j];
-            ONSBuf* dst_buffer = (ONSBuf*) accumulation_surface->pixels + i * total_width + j;
+    // ...then each coarser level from the four cells of the one below.
+    for (int level = MOSAIC_LEVELS - 1; ; --level) {
+        std::vector<ONSBuf>& cells = mosaic_cells[level];
+        cells.resize(cols * rows);
+        for (int i = 0; i < cols * rows; ++i) {
+            const MosaicSum& c = sums[i];
+            ONSBuf p = 0;
+            for (int k = 0; k < 4; ++k)
+                p |= ONSBuf((c.field[k] + c.pixels / 2) / c.pixels)
+                     << mosaic_shift[k];
+            cells[i] = p;
+        }
+        if (level == 0) break;
+
+        int cols2 = (cols + 1) / 2, rows2 = (rows + 1) / 2;
+        std::vector<MosaicSum> sums2(cols2 * rows2);
+        memset(&sums2[0], 0, sums2.size() * sizeof(MosaicSum));
+        for (int r = 0; r < rows; ++r)
+            for (int c = 0; c < cols; ++c) {
+                const MosaicSum& a = sums[r * cols + c];
+                MosaicSum& b = sums2[r / 2 * cols2 + c / 2];
+                for (int k = 0; k < 4; ++k) b.field[k] += a.field[k];
+                b.pixels += a.pixels;
+            }
+        sums.swap(sums2);
+        cols = cols2;
+        rows = rows2;
+    }
+    mosaic_source = src_surface;
+}
 
-            int height2 = width;
-            if (i + 1 - width < 0) height2 = i + 1;
 
-            int width2 = width;
-            if (j + width > screen_width) width2 = screen_width - j;
+void PonscripterLabel::generateMosaic(SDL_Surface* src_surface, int level)
+{
+    // The last frame may ask for a level beyond either end; it is
+    // covered by the finished image straight away.
+    if (level < 0) level = 0;
+    if (level >= MOSAIC_LEVELS) level = MOSAIC_LEVELS - 1;
+    if (mosaic_source != src_surface) buildMosaic(src_surface);
 
-            for (ii = 0; ii < height2; ii++) {
-                for (jj = 0; jj < width2; jj++) {
-                    *dst_buffer++ = p;
-                }
+    SDL_Rect clip = { 0, 0, screen_width, screen_height };
+    if (AnimationInfo::doClipping(&clip, &dirty_rect.bounding_box)) return;
 
-                dst_buffer -= total_width + width2;
-            }
+    int size = 160 >> level;
+    int cols = (screen_width + size - 1) / size;
+    const std::vector<ONSBuf>& cells = mosaic_cells[level];
+
+    // Each row of pixels is filled once per row of cells, and copied
+    // to the rest of it.
+    SDL_LockSurface(accumulation_surface);
+    int pitch = accumulation_surface->pitch;
+    char* pixels = (char*) accumulation_surface->pixels +
+                   clip.x * sizeof(ONSBuf);
+    int bytes = clip.w * sizeof(ONSBuf);
+    for (int y = clip.y + clip.h - 1; y >= clip.y; ) {
+        int r = (screen_height - 1 - y) / size;
+        int top = std::max(screen_height - (r + 1) * size, clip.y);
+        ONSBuf* dst = (ONSBuf*) (pixels + pitch * y);
+        const ONSBuf* cell = &cells[r * cols + clip.x / size];
+        for (int x = clip.x; x < clip.x + clip.w; ++cell) {
+            int end = std::min((x / size + 1) * size, clip.x + clip.w);
+            std::fill(dst, dst + (end - x), *cell);
+            dst += end - x;
+            x = end;
         }
+        for (int i = y - 1; i >= top; --i)
+            memcpy(pixels + pitch * i, pixels + pitch * y, bytes);
+        y = top - 1;
     }
-
     SDL_UnlockSurface(accumulation_surface);
-    SDL_UnlockSurface(src_surface);
 }
@@ -64,6 +64,19 @@ void PonscripterLabel::buildBreakupCellforms()
             }
         }
     }
+
+    // Each cellform is a disc, so each of its rows is a single span.
+    breakup_form_spans.resize(BREAKUP_CELLFORMS * h);
+    for (int n=0; n<BREAKUP_CELLFORMS; n++) {
+        for (int y=0; y<h; y++) {
+            const bool *row = breakup_cellforms + y*w + n*BREAKUP_CELLWIDTH;
+            BreakupSpan &span = breakup_form_spans[n*h + y];
+            span.x0 = 0;
+            while (span.x0 < BREAKUP_CELLWIDTH && !row[span.x0]) span.x0++;
+            span.x1 = span.x0;
+            while (span.x1 < BREAKUP_CELLWIDTH && row[span.x1]) span.x1++;
+        }
+    }
 }
 
 void PonscripterLabel::buildBreakupMask()
@@ -146,6 +159,31 @@ void PonscripterLabel::buildBreakupMask()
 
     SDL_UnlockSurface( effect_dst_surface );
     SDL_UnlockSurface( effect_src_surface );
+
+    // The runs of the mask within each row of each cell.
+    breakup_mask_spans.clear();
+    breakup_mask_rows.clear();
+    for (int cy=0; cy<BREAKUP_MAX_CELL_Y; cy++) {
+        for (int cx=0; cx<BREAKUP_MAX_CELL_X; cx++) {
+            for (int i=0; i<BREAKUP_CELLWIDTH; i++) {
+                breakup_mask_rows.push_back(breakup_mask_spans.size());
+                const bool *row = breakup_mask +
+                    (cy*BREAKUP_CELLWIDTH + i)*w + cx*BREAKUP_CELLWIDTH;
+                for (int j=0; j<BREAKUP_CELLWIDTH; ) {
+                    if (!row[j]) {
+                        j++;
+                        continue;
+                    }
+                    BreakupSpan span;
+                    span.x0 = j;
+                    while (j < BREAKUP_CELLWIDTH && row[j]) j++;
+                    span.x1 = j;
+                    breakup_mask_spans.push_back(span);
+                }
+            }
+        }
+    }
+    breakup_mask_rows.push_back(breakup_mask_spans.size());
 }
 
 void PonscripterLabel::initBreakup( char *params )
@@ -211,6 +249,75 @@ void PonscripterLabel::initBreakup( char *params )
         }
         ++diag_n;
     }
+
+    breakup_cell_at.assign(BREAKUP_MAX_CELLS, -1);
+    for (n=0; n<n_cells; n++) {
+        breakup_cells[n].settled = false;
+        breakup_cell_at[breakup_cells[n].cell_y * BREAKUP_MAX_CELL_X +
+                        breakup_cells[n].cell_x] = n;
+    }
+    breakup_touched.clear();
+
+    // Settled cells don't change from frame to frame, so they are kept
+    // drawn over the background in effect_tmp_surface.
+    SDL_Surface *bg = (breakup_mode & BREAKUP_MODE_PILEUP) ?
+                      effect_src_surface : effect_dst_surface;
+    SDL_BlitSurface(bg, NULL, effect_tmp_surface, NULL);
+}
+
+// Copies a rectangle between surfaces of the same format.
+static void copyRect(SDL_Surface *src, SDL_Surface *dst, SDL_Rect rect)
+{
+    int x0 = std::max(0, int(rect.x)), y0 = std::max(0, int(rect.y));
+    int x1 = std::min(rect.x + rect.w, std::min(src->w, dst->w));
+    int y1 = std::min(rect.y + rect.h, std::min(src->h, dst->h));
+    const int bpp = src->format->BytesPerPixel;
+    for (int y=y0; y<y1; y++)
+        memcpy((Uint8 *)dst->pixels + y*dst->pitch + x0*bpp,
+               (Uint8 *)src->pixels + y*src->pitch + x0*bpp, (x1 - x0)*bpp);
+}
+
+// Copies cell n from src to dst, moved by (dx, dy), wherever the
+// breakup mask is set; and, unless form is negative, only within that
+// cellform.
+void PonscripterLabel::drawBreakupCell(int n, int form, int dx, int dy,
+                                       SDL_Surface *src, SDL_Surface *dst)
+{
+    const BreakupCell &cell = breakup_cells[n];
+    const int x = cell.cell_x * BREAKUP_CELLWIDTH;
+    const int y = cell.cell_y * BREAKUP_CELLWIDTH;
+
+    // Clip the cell once, in cell coordinates.
+    int j0 = std::max(0, std::max(-x, -(x + dx)));
+    int j1 = std::min(int(BREAKUP_CELLWIDTH),
+                      std::min(src->w - x, dst->w - (x + dx)));
+    int i0 = std::max(0, std::max(-y, -(y + dy)));
+    int i1 = std::min(int(BREAKUP_CELLWIDTH),
+                      std::min(src->h - y, dst->h - (y + dy)));
+    if (j0 >= j1 || i0 >= i1) return;
+
+    const int src_pitch = src->pitch / sizeof(ONSBuf);
+    const int dst_pitch = dst->pitch / sizeof(ONSBuf);
+    const ONSBuf *src_buf = (const ONSBuf *)src->pixels + y*src_pitch + x;
+    ONSBuf *dst_buf = (ONSBuf *)dst->pixels + (y + dy)*dst_pitch + x + dx;
+    const int *rows = &breakup_mask_rows[(cell.cell_y * BREAKUP_MAX_CELL_X +
+                                          cell.cell_x) * BREAKUP_CELLWIDTH];
+    for (int i=i0; i<i1; i++) {
+        int l = j0, r = j1;
+        if (form >= 0) {
+            const BreakupSpan &f =
+                breakup_form_spans[form*BREAKUP_CELLWIDTH + i];
+            l = std::max(l, f.x0);
+            r = std::min(r, f.x1);
+        }
+        for (int k=rows[i]; k<rows[i+1] && l<r; k++) {
+            const BreakupSpan &m = breakup_mask_spans[k];
+            const int a = std::max(l, m.x0), b = std::min(r, m.x1);
+            if (a < b)
+                memcpy(dst_buf + i*dst_pitch + a, src_buf + i*src_pitch + a,
+                       (b - a) * sizeof(ONSBuf));
+        }
+    }
 }
 
 void PonscripterLabel::effectBreakup( char *params, int duration )
@@ -234,8 +341,8 @@ void PonscripterLabel::effectBreakup( char *params, int duration )
         x_dir = -x_dir;
         y_dir = -y_dir;
     }
-    SDL_BlitSurface(bg, NULL, accumulation_surface, NULL);
     SDL_Surface *dst = accumulation_surface;
+    SDL_Surface *layer = effect_tmp_surface;
 
     if (breakup_mode & BREAKUP_MODE_JUMBLE) {
         x_dir = -x_dir;
@@ -248,74 +355,86 @@ void PonscripterLabel::effectBreakup( char *params, int duration )
         y_dir = -y_dir;
     }
 
+    SDL_LockSurface( bg );
     SDL_LockSurface( chr );
+    SDL_LockSurface( layer );
     SDL_LockSurface( dst );
-    ONSBuf *chr_buf = (ONSBuf *)chr->pixels;
-    ONSBuf *buffer  = (ONSBuf *)dst->pixels;
-    bool *msk_buf = breakup_cellforms;
 
+    // Bring the background layer up to date with the cells that have
+    // settled or come loose since the last frame.
     for (int n=0; n<n_cells; ++n) {
-        SDL_Rect rect = { breakup_cells[n].cell_x * BREAKUP_CELLWIDTH,
-                          breakup_cells[n].cell_y * BREAKUP_CELLWIDTH, 
-                          BREAKUP_CELLWIDTH, BREAKUP_CELLWIDTH };
-        breakup_cells[n].state += frame_diff;
-        if (breakup_cells[n].state >= (BREAKUP_MOVE_FRAMES + BREAKUP_STILL_STATE)) {
-            for (int i=0; i<BREAKUP_CELLWIDTH; ++i) {
-                for (int j=0; j<BREAKUP_CELLWIDTH; ++j) {
-                    int x = rect.x + j;
-                    int y = rect.y + i;
-                    if ((x < 0) || (x >= dst->w) || (x >= chr->w) ||
-                        (y < 0) || (y >= dst->h) || (y >= chr->h))
-                        continue;
-                    if ( breakup_mask[y*BREAKUP_CELLWIDTH*BREAKUP_MAX_CELL_X + x] )
-                        buffer[y*dst->w + x] = chr_buf[y*chr->w + x];
-                }
-            }
+        BreakupCell &cell = breakup_cells[n];
+        cell.state += frame_diff;
+        bool settled = cell.state >= (BREAKUP_MOVE_FRAMES + BREAKUP_STILL_STATE);
+        if (settled == cell.settled) continue;
+
+        cell.settled = settled;
+        if (settled) {
+            drawBreakupCell(n, -1, 0, 0, chr, layer);
         }
-        else if (breakup_cells[n].state >= BREAKUP_MOVE_FRAMES) {
-            breakup_cells[n].radius = breakup_cells[n].state - (BREAKUP_MOVE_FRAMES*3/4) + 1;
-            for (int i=0; i<BREAKUP_CELLWIDTH; i++) {
-                for (int j=0; j<BREAKUP_CELLWIDTH; j++) {
-                    int x = rect.x + j;
-                    int y = rect.y + i;
-                    if ((x < 0) || (x >= dst->w) || (x >= chr->w) ||
-                        (y < 0) || (y >= dst->h) || (y >= chr->h))
-                        continue;
-                    int msk_off = BREAKUP_CELLWIDTH*breakup_cells[n].radius;
-                    if ( msk_buf[BREAKUP_CELLWIDTH * BREAKUP_CELLFORMS * i + msk_off + j] &&
-                         breakup_mask[y*BREAKUP_CELLWIDTH*BREAKUP_MAX_CELL_X + x] )
-                        buffer[y*dst->w + x] = chr_buf[y*chr->w + x];
-                }
-            }
+        else {
+            SDL_Rect rect = { cell.cell_x * BREAKUP_CELLWIDTH,
+                              cell.cell_y * BREAKUP_CELLWIDTH,
+                              BREAKUP_CELLWIDTH, BREAKUP_CELLWIDTH };
+            copyRect(bg, layer, rect);
+        }
+    }
+
+    SDL_Rect screen_rect = { 0, 0, dst->w, dst->h };
+    copyRect(layer, dst, screen_rect);
+
+    // Cells are drawn in order, and settled cells come either all
+    // before the rest (piling up) or all after them.  In the latter
+    // case any settled cell that a moving one strays over is drawn
+    // again on top.
+    const bool settled_on_top = !(breakup_mode & BREAKUP_MODE_PILEUP);
+    for (int n=0; n<n_cells; ++n) {
+        BreakupCell &cell = breakup_cells[n];
+        if (cell.settled || cell.state < 0) continue;
+
+        if (cell.state >= BREAKUP_MOVE_FRAMES) {
+            cell.radius = cell.state - (BREAKUP_MOVE_FRAMES*3/4) + 1;
+            drawBreakupCell(n, cell.radius, 0, 0, chr, dst);
+            continue;
         }
-        else if (breakup_cells[n].state >= 0) {
-            int state = breakup_cells[n].state;
-            int disp_x = x_dir * breakup_disp_x[breakup_cells[n].dir] * (state-BREAKUP_MOVE_FRAMES);
-            int disp_y = y_dir * breakup_disp_y[breakup_cells[n].dir] * (BREAKUP_MOVE_FRAMES-state);
 
-            breakup_cells[n].radius = 0;
-            if (breakup_cells[n].state >= (BREAKUP_MOVE_FRAMES/2))
-                breakup_cells[n].radius = (breakup_cells[n].state/2) - (BREAKUP_MOVE_FRAMES/4) + 1;
-            for (int i=0; i<BREAKUP_CELLWIDTH; i++) {
-                for (int j=0; j<BREAKUP_CELLWIDTH; j++) {
-                    int x = disp_x + rect.x + j;
-                    int y = disp_y + rect.y + i;
-                    if ((x < 0) || (x >= dst->w) ||
-                        (y < 0) || (y >= dst->h))
-                        continue;
-                    if (((rect.x+j)<0) || ((rect.x+j) >= chr->w) ||
-                        ((rect.y+i)<0) || ((rect.y+i) >= chr->h))
+        int state = cell.state;
+        int disp_x = x_dir * breakup_disp_x[cell.dir] * (state-BREAKUP_MOVE_FRAMES);
+        int disp_y = y_dir * breakup_disp_y[cell.dir] * (BREAKUP_MOVE_FRAMES-state);
+
+        cell.radius = 0;
+        if (cell.state >= (BREAKUP_MOVE_FRAMES/2))
+            cell.radius = (cell.state/2) - (BREAKUP_MOVE_FRAMES/4) + 1;
+        drawBreakupCell(n, cell.radius, disp_x, disp_y, chr, dst);
+
+        if (settled_on_top) {
+            // The grid squares the cell is over, rounding down, as it
+            // may have moved off the top or left of the screen.
+            int x = cell.cell_x * BREAKUP_CELLWIDTH + disp_x;
+            int y = cell.cell_y * BREAKUP_CELLWIDTH + disp_y;
+            int cx0 = (x >= 0 ? x : x - BREAKUP_CELLWIDTH + 1) / BREAKUP_CELLWIDTH;
+            int cy0 = (y >= 0 ? y : y - BREAKUP_CELLWIDTH + 1) / BREAKUP_CELLWIDTH;
+            for (int cy=cy0; cy<=cy0+1; cy++) {
+                for (int cx=cx0; cx<=cx0+1; cx++) {
+                    if (cx < 0 || cx >= BREAKUP_MAX_CELL_X ||
+                        cy < 0 || cy >= BREAKUP_MAX_CELL_Y)
                         continue;
-                    int msk_off = BREAKUP_CELLWIDTH*breakup_cells[n].radius;
-                    if ( msk_buf[BREAKUP_CELLWIDTH * BREAKUP_CELLFORMS * i + msk_off + j] &&
-                         breakup_mask[(rect.y+i)*BREAKUP_CELLWIDTH*BREAKUP_MAX_CELL_X + rect.x + j] )
-                        buffer[y*dst->w + x] =
-                            chr_buf[(rect.y+i)*chr->w + rect.x + j];
+                    int m = breakup_cell_at[cy*BREAKUP_MAX_CELL_X + cx];
+                    if (m >= 0 && breakup_cells[m].settled)
+                        breakup_touched.push_back(m);
                 }
             }
         }
     }
 
-    SDL_UnlockSurface( accumulation_surface );
+    // Settled cells don't overlap one another, so their order doesn't
+    // matter, and drawing one twice does no harm.
+    for (size_t k=0; k<breakup_touched.size(); ++k)
+        drawBreakupCell(breakup_touched[k], -1, 0, 0, chr, dst);
+    breakup_touched.clear();
+
+    SDL_UnlockSurface( dst );
+    SDL_UnlockSurface( layer );
     SDL_UnlockSurface( chr );
+    SDL_UnlockSurface( bg );
 }
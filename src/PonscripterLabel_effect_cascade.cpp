@@ -25,6 +25,63 @@
 
 #include "PonscripterLabel.h"
 
+typedef PonscripterLabel::ONSBuf ONSBuf;
+
+static inline ONSBuf* pixelRow(SDL_Surface* surface, int y)
+{
+    return (ONSBuf*) ((char*) surface->pixels + y * surface->pitch);
+}
+
+// Spreads column src_x of src over columns [start, end) of dst, within
+// clip.  A column off the surface copies nothing, as a blit wouldn't.
+static void cascadeColumns(SDL_Surface* src, int src_x, SDL_Surface* dst,
+                           int start, int end, const SDL_Rect& clip)
+{
+    if (src_x < 0 || src_x >= src->w) return;
+    start = std::max(start, int(clip.x));
+    end = std::min(end, clip.x + clip.w);
+    if (start >= end) return;
+
+    SDL_LockSurface(src);
+    SDL_LockSurface(dst);
+    for (int y = clip.y; y < clip.y + clip.h; ++y) {
+        ONSBuf* d = pixelRow(dst, y);
+        std::fill(d + start, d + end, pixelRow(src, y)[src_x]);
+    }
+    SDL_UnlockSurface(dst);
+    SDL_UnlockSurface(src);
+}
+
+// Copies row src_y of src over rows [start, end) of dst, within clip.
+static void cascadeRows(SDL_Surface* src, int src_y, SDL_Surface* dst,
+                        int start, int end, const SDL_Rect& clip)
+{
+    if (src_y < 0 || src_y >= src->h) return;
+    start = std::max(start, int(clip.y));
+    end = std::min(end, clip.y + clip.h);
+    if (start >= end || clip.w <= 0) return;
+
+    SDL_LockSurface(src);
+    SDL_LockSurface(dst);
+    const ONSBuf* s = pixelRow(src, src_y) + clip.x;
+    const size_t bytes = clip.w * sizeof(ONSBuf);
+    for (int y = start; y < end; ++y) {
+        ONSBuf* d = pixelRow(dst, y) + clip.x;
+        if (d != s) memcpy(d, s, bytes);
+    }
+    SDL_UnlockSurface(dst);
+    SDL_UnlockSurface(src);
+}
+
+// Copies the part of rect within clip from src to dst.
+static void cascadeBlock(SDL_Surface* src, SDL_Surface* dst, SDL_Rect rect,
+                         const SDL_Rect& clip)
+{
+    if (SDL_IntersectRect(&rect, &clip, &rect))
+        SDL_BlitSurface(src, &rect, dst, &rect);
+}
+
+
 void PonscripterLabel::effectCascade( char *params, int duration )
 {
     enum {
@@ -41,7 +98,6 @@ void PonscripterLabel::effectCascade( char *params, int duration )
 
     SDL_Surface *src_surface, *dst_surface;
     SDL_Rect src_rect={0, 0, screen_width, screen_height};
-    SDL_Rect dst_rect={0, 0, screen_width, screen_height};
     int mode, width, start, end;
  
     if (params[0] == 'u')
@@ -70,58 +126,48 @@ void PonscripterLabel::effectCascade( char *params, int duration )
     if (effect_counter == 0)
         effect_tmp = 0;
 
+    // Lines are copied directly rather than blitted one at a time.
+    const SDL_Rect& clip = dirty_rect.bounding_box;
     if (mode & CASCADE_LR) {
         // moves left-right
         width = screen_width * effect_counter / duration;
         if (!(mode & CASCADE_IN))
             width = screen_width - width;
 
-        src_rect.y = dst_rect.y = 0;
-        src_rect.h = dst_rect.h = screen_height;
-        src_rect.w = dst_rect.w = 1;
         if ((mode & CASCADE_CROSS) && (width > 0)) {
             // need to cascade-out the src
             if (mode & CASCADE_DIR) {
                 // moves right
                 start = 0;
                 end = width;
-                dst_rect.x = end;
+                cascadeColumns(effect_src_surface, end, effect_src_surface,
+                               start, end, clip);
             } else {
                 // moves left
                 start = screen_width - width;
                 end = screen_width;
-                dst_rect.x = start;
-            }
-            src_rect.x = 0;
-            SDL_BlitSurface(effect_src_surface, &dst_rect, accumulation_surface, &src_rect);
-            for (int i=start; i<end; i++) {
-                dst_rect.x = i;
-                SDL_BlitSurface(accumulation_surface, &src_rect, effect_src_surface, &dst_rect);
+                cascadeColumns(effect_src_surface, start, effect_src_surface,
+                               start, end, clip);
             }
         }
         if (mode & CASCADE_DIR) {
             // moves right
             start = width;
             end = screen_width;
-            src_rect.x = start;
+            cascadeColumns(src_surface, start, dst_surface, start, end, clip);
         } else {
             // moves left
             start = 0;
             end = screen_width - width;
-            src_rect.x = end;
-        }
-        for (int i=start; i<end; i++) {
-            dst_rect.x = i;
-            SDL_BlitSurface(src_surface, &src_rect, dst_surface, &dst_rect);
+            cascadeColumns(src_surface, end, dst_surface, start, end, clip);
         }
         if ((mode & CASCADE_IN) && (width > 0)) {
             if (mode & CASCADE_DIR)
                 src_rect.x = effect_tmp;
             else
                 src_rect.x = screen_width - width;
-            dst_rect.x = src_rect.x;
-            src_rect.w = dst_rect.w = width - effect_tmp;
-            SDL_BlitSurface(src_surface, &src_rect, dst_surface, &dst_rect);
+            src_rect.w = width - effect_tmp;
+            cascadeBlock(src_surface, dst_surface, src_rect, clip);
             effect_tmp = width;
         }
     } else {
@@ -130,52 +176,40 @@ void PonscripterLabel::effectCascade( char *params, int duration )
         if (!(mode & CASCADE_IN))
             width = screen_height - width;
 
-        src_rect.x = dst_rect.x = 0;
-        src_rect.h = dst_rect.h = 1;
-        src_rect.w = dst_rect.w = screen_width;
         if ((mode & CASCADE_CROSS) && (width > 0)) {
             // need to cascade-out the src
             if (mode & CASCADE_DIR) {
                 // moves down
                 start = 0;
                 end = width;
-                dst_rect.y = end;
+                cascadeRows(effect_src_surface, end, effect_src_surface,
+                            start, end, clip);
             } else {
                 // moves up
                 start = screen_height - width;
                 end = screen_height;
-                dst_rect.y = start;
-            }
-            src_rect.y = 0;
-            SDL_BlitSurface(effect_src_surface, &dst_rect, accumulation_surface, &src_rect);
-            for (int i=start; i<end; i++) {
-                dst_rect.y = i;
-                SDL_BlitSurface(accumulation_surface, &src_rect, effect_src_surface, &dst_rect);
+                cascadeRows(effect_src_surface, start, effect_src_surface,
+                            start, end, clip);
             }
         }
         if (mode & CASCADE_DIR) {
             // moves down
             start = width;
             end = screen_height;
-            src_rect.y = start;
+            cascadeRows(src_surface, start, dst_surface, start, end, clip);
         } else {
             // moves up
             start = 0;
             end = screen_height - width;
-            src_rect.y = end;
-        }
-        for (int i=start; i<end; i++) {
-            dst_rect.y = i;
-            SDL_BlitSurface(src_surface, &src_rect, dst_surface, &dst_rect);
+            cascadeRows(src_surface, end, dst_surface, start, end, clip);
         }
         if ((mode & CASCADE_IN) && (width > 0)) {
             if (mode & CASCADE_DIR)
                 src_rect.y = effect_tmp;
             else
                 src_rect.y = screen_height - width;
-            dst_rect.y = src_rect.y;
-            src_rect.h = dst_rect.h = width - effect_tmp;
-            SDL_BlitSurface(src_surface, &src_rect, dst_surface, &dst_rect);
+            src_rect.h = width - effect_tmp;
+            cascadeBlock(src_surface, dst_surface, src_rect, clip);
             effect_tmp = width;
         }
     }
@@ -25,6 +25,7 @@
  */
 
 #include "PonscripterLabel.h"
+#include "WorkerPool.h"
 
 void PonscripterLabel::buildSinTable()
 {
@@ -102,6 +103,7 @@ void PonscripterLabel::buildWhirlTable()
 
     whirl_table = new int[screen_height * screen_width];
     int *dst_buffer = whirl_table;
+    int max_radius = 0;
 
     for ( int i=0 ; i<screen_height ; ++i ){
         for ( int j=0; j<screen_width ; ++j, ++dst_buffer ){
@@ -109,6 +111,47 @@ void PonscripterLabel::buildWhirlTable()
             // actual x = x + 0.5, actual y = y + 0.5;
             // (x+0.5)^2 + (y+0.5)^2 = x^2 + x + 0.25 + y^2 + y + 0.25
             *dst_buffer = (int)(sqrt((float)(x * x + x + y * y + y) + 0.5) * 4);
+            if (*dst_buffer > max_radius) max_radius = *dst_buffer;
+        }
+    }
+    whirl_cos.resize(max_radius + 1);
+    whirl_sin.resize(max_radius + 1);
+}
+
+struct WhirlJob {
+    const AnimationInfo::ONSBuf* src;
+    AnimationInfo::ONSBuf* dst;
+    const int* radius;
+    const int* cos_r;
+    const int* sin_r;
+    int width, height, x0, x1;
+};
+
+// Rotates each pixel of rows [begin, end) by the angle for its radius.
+void PonscripterLabel::whirlRows(void* job, int begin, int end)
+{
+    // Copied out, since stores to the pixels could otherwise alias them.
+    const WhirlJob w = *(const WhirlJob*) job;
+    const int width = w.width, height = w.height;
+    const int center_x = width / 2, center_y = height / 2;
+    const int* cos_r = w.cos_r;
+    const int* sin_r = w.sin_r;
+
+    for (int i = begin; i < end; ++i) {
+        ONSBuf* dst = w.dst + width * i;
+        const int* radius = w.radius + width * i;
+        const int y2 = (i - center_y) * 2 + 1;
+        for (int j = w.x0; j < w.x1; ++j) {
+            //working on x+0.5, hence (2x+1)/2
+            const int x2 = (j - center_x) * 2 + 1;
+            const int c = cos_r[radius[j]], s = sin_r[radius[j]];
+            int jj = ((x2 * c - y2 * s) / TRIG_FACTOR - 1) / 2 + center_x;
+            int ii = ((x2 * s + y2 * c) / TRIG_FACTOR - 1) / 2 + center_y;
+            if (jj < 0) jj = 0;
+            if (jj >= width) jj = width - 1;
+            if (ii < 0) ii = 0;
+            if (ii >= height) ii = height - 1;
+            dst[j] = w.src[width * ii + jj];
         }
     }
 }
@@ -130,51 +173,42 @@ void PonscripterLabel::effectWhirl( char *params, int duration )
     //float rad_amp = M_PI * (sin(t) - one_minus_cos);
     //float rad_base = M_PI * 2 * one_minus_cos + rad_amp;
 
+    // The angle depends only on the radius, so work it out once for
+    // each radius rather than for each pixel.
+    for (int r = 0; r < (int) whirl_cos.size(); ++r) {
+        //whirl factor
+        int theta = r % TRIG_TABLE_SIZE;
+        theta = ((rad_amp * sin_table[theta] / TRIG_FACTOR) + rad_base) *
+                direction;
+        //float theta = direction * (rad_base + rad_amp *
+        //                           sin(sqrt(x * x + y * y) * OMEGA));
+        theta %= TRIG_TABLE_SIZE;
+        if (theta < 0) theta += TRIG_TABLE_SIZE;
+        whirl_cos[r] = cos_table[theta];
+        whirl_sin[r] = sin_table[theta];
+    }
+
     int width = 256 * effect_counter / duration;
     alphaMaskBlend( NULL, ALPHA_BLEND_CONST, width, &dirty_rect.bounding_box,
                  NULL, NULL, effect_tmp_surface );
 
+    // Only the dirty region is shown, though any of the screen may be
+    // rotated into it.
+    SDL_Rect& r = dirty_rect.bounding_box;
     SDL_LockSurface( effect_tmp_surface );
     SDL_LockSurface( accumulation_surface );
-    ONSBuf *src_buffer = (ONSBuf *)effect_tmp_surface->pixels;
-    ONSBuf *dst_buffer = (ONSBuf *)accumulation_surface->pixels;
-    int *whirl_buffer = whirl_table;
-
-    for ( int i=0 ; i<screen_height ; ++i ){
-        for ( int j=0 ; j<screen_width ; ++j, ++dst_buffer, ++whirl_buffer ){
-            int ii=i, jj=j;
-            // actual x = x + 0.5, actual y = y + 0.5
-            int x = j - CENTER_X, y = i - CENTER_Y;
-            //whirl factor
-            int theta = *whirl_buffer;
-            while (theta < 0) theta += TRIG_TABLE_SIZE;
-            theta %= TRIG_TABLE_SIZE;
-            theta = ((rad_amp * sin_table[theta] / TRIG_FACTOR) + rad_base) *
-                    direction;
-            //float theta = direction * (rad_base + rad_amp * 
-            //                           sin(sqrt(x * x + y * y) * OMEGA));
-
-            //perform rotation
-            while (theta < 0) theta += TRIG_TABLE_SIZE;
-            theta %= TRIG_TABLE_SIZE;
-            //working on x+0.5, hence (2x+1)/2
-            jj = (((x + x + 1) * cos_table[theta] -
-                   (y + y + 1) * sin_table[theta])/TRIG_FACTOR - 1)/2 +
-                 CENTER_X;
-            ii = (((x + x + 1) * sin_table[theta] +
-                   (y + y + 1) * cos_table[theta])/TRIG_FACTOR - 1)/2 +
-                 CENTER_Y;
-            //jj = (int) (x * cos_theta - y * sin_theta + CENTER_X);
-            //ii = (int) (x * sin_theta + y * cos_theta + CENTER_Y);
-            if (jj < 0) jj = 0;
-            if (jj >= screen_width) jj = screen_width-1;
-            if (ii < 0) ii = 0;
-            if (ii >= screen_height) ii = screen_height-1;
-
-            // change pixel value!
-            *dst_buffer = *(src_buffer + screen_width * ii + jj);
-        }
-    }
+    WhirlJob w;
+    w.src = (const ONSBuf *)effect_tmp_surface->pixels;
+    w.dst = (ONSBuf *)accumulation_surface->pixels;
+    w.radius = whirl_table;
+    w.cos_r = &whirl_cos[0];
+    w.sin_r = &whirl_sin[0];
+    w.width = screen_width;
+    w.height = screen_height;
+    w.x0 = r.x < 0 ? 0 : r.x;
+    w.x1 = r.x + r.w > screen_width ? screen_width : r.x + r.w;
+    WorkerPool::run(whirlRows, &w, r.y < 0 ? 0 : r.y,
+                    r.y + r.h > screen_height ? screen_height : r.y + r.h);
 
     SDL_UnlockSurface( accumulation_surface );
     SDL_UnlockSurface( effect_tmp_surface );
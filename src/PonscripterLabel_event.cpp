@@ -285,6 +285,7 @@ void PonscripterLabel::startTimer(int count)
 void PonscripterLabel::advancePhase(int count) {
     timer_event_time = SDL_GetTicks() + count;
     timer_event_flag = true;
+    if (in_fast_forward) return; // fastForward() looks for it itself
 
     SDL_Event event;
     event.type = INTERNAL_REDRAW_EVENT;
@@ -1370,6 +1371,7 @@ int PonscripterLabel::eventLoop()
                 /* It has been longer than the refresh delay since we last started a refresh. Start another */
 
                 last_refresh = current_time;
+                presentDeferred();
                 rerender();
 
                 if (renderTimesFile) {
@@ -1412,7 +1414,22 @@ int PonscripterLabel::eventLoop()
                             case RENDER_EVENT_LOAD_IMAGE: eventName = "ImageLoad";  break;
                         }
                         fprintf(renderTimesFile, "%d,%s,%f\n", frameNo, eventName, msElapsed);
+                        /* Compositing before an effect's first frame, effect frames skipped (as the refresh
+                         * time they cover), and effect frames finished after their refresh */
+                        if (effect_setup_ticks)
+                            fprintf(renderTimesFile, "%d,EffectSetup,%f\n", frameNo,
+                                    effect_setup_ticks * perfMultiplier);
+                        if (effect_dropped)
+                            fprintf(renderTimesFile, "%d,EffectDropped,%f\n", frameNo,
+                                    effect_dropped * effect_frame_ticks * perfMultiplier);
+                        if (effect_late_ticks)
+                            fprintf(renderTimesFile, "%d,EffectLate,%f\n", frameNo,
+                                    effect_late_ticks * perfMultiplier);
                     }
+                    effect_dropped = 0;
+                    effect_late_ticks = 0;
+                    effect_setup_ticks = 0;
+                    if (fastForwarding()) fastForward();
                 } else if(last_refresh <= current_time && refresh_delay >= (current_time - last_refresh)) {
                     SDL_Delay(std::min(refresh_delay / 3, refresh_delay - (current_time - last_refresh)));
                 }
@@ -24,6 +24,7 @@
  */
 
 #include "PonscripterLabel.h"
+#include "WorkerPool.h"
 #include <cstdio>
 
 #include "graphics_common.h"
@@ -279,49 +280,36 @@ SDL_Surface *PonscripterLabel::createSurfaceFromFile(const pstring& filename,
 }
 
 
-// alphaMaskBlend
-// dst: accumulation_surface
-// src1: effect_src_surface
-// src2: effect_dst_surface
-void PonscripterLabel::alphaMaskBlend(SDL_Surface *mask_surface, int trans_mode,
-                                      Uint32 mask_value, SDL_Rect *clip,
-                                      SDL_Surface *src1, SDL_Surface *src2,
-                                      SDL_Surface *dst)
-{
-    SDL_Rect rect = {0, 0, screen_width, screen_height};
-
-    if (src1 == NULL)
-        src1 = effect_src_surface;
-    if (src2 == NULL)
-        src2 = effect_dst_surface;
-    if (dst == NULL)
-        dst = accumulation_surface;
-
-    /* ---------------------------------------- */
-    /* clipping */
-    if ( clip ){
-        if ( AnimationInfo::doClipping( &rect, clip ) ) return;
-    }
+struct MaskBlendJob {
+    SDL_Surface *mask_surface, *src1, *src2, *dst;
+    int trans_mode, screen_width;
+    Uint32 mask_value;
+    SDL_Rect rect;
+};
 
-    /* ---------------------------------------- */
+// Blends rows [begin, end) of the job's rect.  Each row is blended
+// just as it would be with the rest, the mask row following from y.
+void PonscripterLabel::alphaMaskBlendRows(void* job, int begin, int end)
+{
+    const MaskBlendJob& b = *(const MaskBlendJob*) job;
+    SDL_Surface *mask_surface = b.mask_surface;
+    SDL_Surface *src1 = b.src1, *src2 = b.src2, *dst = b.dst;
+    const int trans_mode = b.trans_mode;
+    const Uint32 mask_value = b.mask_value;
+    SDL_Rect rect = b.rect;
+    rect.y = begin;
+    rect.h = end - begin;
 
-    SDL_LockSurface( src1 );
-    SDL_LockSurface( src2 );
-    SDL_LockSurface( dst );
-    if ( mask_surface ) SDL_LockSurface( mask_surface );
-    
     ONSBuf *src1_buffer = (ONSBuf *)src1->pixels + src1->w * rect.y + rect.x;
     ONSBuf *src2_buffer = (ONSBuf *)src2->pixels + src2->w * rect.y + rect.x;
     ONSBuf *dst_buffer  = (ONSBuf *)dst->pixels + dst->w * rect.y + rect.x;
 
-    const int rwidth = screen_width - rect.w;
+    const int rwidth = b.screen_width - rect.w;
     SDL_PixelFormat *fmt = dst->format;
     Uint32 overflow_mask = 0xffffffff;
     if ( trans_mode != ALPHA_BLEND_FADE_MASK )
         overflow_mask = ~fmt->Bmask;
 
-    mask_value >>= fmt->Bloss;
-
     if (( trans_mode == ALPHA_BLEND_FADE_MASK || trans_mode == ALPHA_BLEND_CROSSFADE_MASK ) && mask_surface) {
         bool accelerated_ok = sizeof(ONSBuf) == 4 && fmt->Bmask == 0xff;
         if (accelerated_ok) {
@@ -375,7 +363,54 @@ void PonscripterLabel::alphaMaskBlend(SDL_Surface *mask_surface, int trans_mode,
             }
         }
     }
-    
+}
+
+
+// alphaMaskBlend
+// dst: accumulation_surface
+// src1: effect_src_surface
+// src2: effect_dst_surface
+void PonscripterLabel::alphaMaskBlend(SDL_Surface *mask_surface, int trans_mode,
+                                      Uint32 mask_value, SDL_Rect *clip,
+                                      SDL_Surface *src1, SDL_Surface *src2,
+                                      SDL_Surface *dst)
+{
+    SDL_Rect rect = {0, 0, screen_width, screen_height};
+
+    if (src1 == NULL)
+        src1 = effect_src_surface;
+    if (src2 == NULL)
+        src2 = effect_dst_surface;
+    if (dst == NULL)
+        dst = accumulation_surface;
+
+    /* ---------------------------------------- */
+    /* clipping */
+    if ( clip ){
+        if ( AnimationInfo::doClipping( &rect, clip ) ) return;
+    }
+
+    /* ---------------------------------------- */
+
+    SDL_LockSurface( src1 );
+    SDL_LockSurface( src2 );
+    SDL_LockSurface( dst );
+    if ( mask_surface ) SDL_LockSurface( mask_surface );
+
+    MaskBlendJob b;
+    b.mask_surface = mask_surface;
+    b.src1 = src1;
+    b.src2 = src2;
+    b.dst = dst;
+    b.trans_mode = trans_mode;
+    b.screen_width = screen_width;
+    b.mask_value = mask_value >> dst->format->Bloss;
+    b.rect = rect;
+    // Strips of at least 32K pixels, so that small rects stay on
+    // this thread.
+    WorkerPool::run(alphaMaskBlendRows, &b, rect.y, rect.y + rect.h,
+                    std::max(1, 32768 / std::max(1, int(rect.w))));
+
     if ( mask_surface ) SDL_UnlockSurface( mask_surface );
     SDL_UnlockSurface( dst );
     SDL_UnlockSurface( src2 );
@@ -383,6 +418,134 @@ void PonscripterLabel::alphaMaskBlend(SDL_Surface *mask_surface, int trans_mode,
 }
 
 
+// The weight a pixel of mask level gets at mask_value.  The
+// accelerated blends ramp up from the level for both kinds of fade;
+// the plain one steps straight to full for a plain fade.
+static inline Uint32 maskWeight(int level, Uint32 mask_value, bool ramp)
+{
+    if (mask_value <= Uint32(level)) return 0;
+    if (!ramp || mask_value - level > 0xff) return 0xff;
+    return mask_value - level;
+}
+
+
+void PonscripterLabel::initMaskFade(SDL_Surface *mask_surface)
+{
+    mask_spans.clear();
+    mask_drawn = -1;
+    mask_rect = dirty_rect.bounding_box;
+    SDL_Rect rect = {0, 0, screen_width, screen_height};
+    if (!mask_surface || AnimationInfo::doClipping(&rect, &mask_rect) ||
+        sizeof(ONSBuf) != 4 || accumulation_surface->format->Bmask != 0xff)
+        return;
+
+    // An empty rect asks which blend would run without drawing anything.
+    SDL_Rect none = {0, 0, 0, 0};
+    mask_accelerated = AnimationInfo::gfx.alphaMaskBlend(accumulation_surface,
+        effect_src_surface, effect_dst_surface, mask_surface, none, 0);
+
+    // Counts the runs of each level, then files them by level.
+    int count[256] = { 0 };
+    for (int k = 0; k < 256; ++k) mask_level_pixels[k] = 0;
+    SDL_LockSurface(mask_surface);
+    for (int pass = 0; pass < 2; ++pass) {
+        for (int y = rect.y; y < rect.y + rect.h; ++y) {
+            const ONSBuf* mask = (const ONSBuf*) mask_surface->pixels +
+                                 mask_surface->w * (y % mask_surface->h);
+            int x = rect.x;
+            while (x < rect.x + rect.w) {
+                Uint32 level = mask[x % mask_surface->w] & 0xff;
+                int start = x;
+                while (++x < rect.x + rect.w &&
+                       (mask[x % mask_surface->w] & 0xff) == level)
+                    ;
+                if (pass == 0) {
+                    ++count[level];
+                    mask_level_pixels[level] += x - start;
+                }
+                else {
+                    MaskSpan& s = mask_spans[count[level]++];
+                    s.offset = y * screen_width + start;
+                    s.length = x - start;
+                }
+            }
+        }
+        if (pass == 0) {
+            mask_level_start[0] = 0;
+            for (int k = 0; k < 256; ++k) {
+                mask_level_start[k + 1] = mask_level_start[k] + count[k];
+                count[k] = mask_level_start[k];
+            }
+            mask_spans.resize(mask_level_start[256]);
+        }
+    }
+    SDL_UnlockSurface(mask_surface);
+}
+
+
+// Draws a frame of a fade with a mask into accumulation_surface, as
+// alphaMaskBlend() would.  Pixels whose weight is the same as in the
+// last frame already hold what it would draw, and are left alone.
+void PonscripterLabel::maskFade(SDL_Surface *mask_surface, int trans_mode,
+                                Uint32 mask_value)
+{
+    SDL_Rect& r = dirty_rect.bounding_box;
+    bool same_rect = r.x == mask_rect.x && r.y == mask_rect.y &&
+                     r.w == mask_rect.w && r.h == mask_rect.h;
+    if (mask_spans.empty() || !same_rect || mask_drawn < 0) {
+        alphaMaskBlend(mask_surface, trans_mode, mask_value, &r);
+        if (!mask_spans.empty() && same_rect) mask_drawn = mask_value;
+        return;
+    }
+
+#ifndef BPP16
+    const bool ramp = mask_accelerated ||
+                      trans_mode == ALPHA_BLEND_CROSSFADE_MASK;
+    bool changed[256];
+    int pixels = 0;
+    for (int k = 0; k < 256; ++k) {
+        changed[k] = maskWeight(k, mask_value, ramp) !=
+                     maskWeight(k, mask_drawn, ramp);
+        if (changed[k]) pixels += mask_level_pixels[k];
+    }
+    mask_drawn = mask_value;
+    if (pixels == 0) return;
+
+    // Beyond a fraction of the rect, blending the whole of it is
+    // quicker, on several threads and a pixel vector at a time.
+    if (pixels > mask_rect.w * mask_rect.h / (mask_accelerated ? 8 : 2)) {
+        alphaMaskBlend(mask_surface, trans_mode, mask_value, &r);
+        return;
+    }
+
+    SDL_LockSurface(effect_src_surface);
+    SDL_LockSurface(effect_dst_surface);
+    SDL_LockSurface(accumulation_surface);
+    const ONSBuf* src1 = (const ONSBuf*) effect_src_surface->pixels;
+    const ONSBuf* src2 = (const ONSBuf*) effect_dst_surface->pixels;
+    ONSBuf* dst = (ONSBuf*) accumulation_surface->pixels;
+    for (int k = 0; k < 256; ++k) {
+        if (!changed[k]) continue;
+        Uint32 mask2 = maskWeight(k, mask_value, ramp);
+        Uint32 mask1 = mask2 ^ 0xff;
+        for (int i = mask_level_start[k]; i < mask_level_start[k + 1]; ++i) {
+            const MaskSpan& s = mask_spans[i];
+            const ONSBuf* src1_buffer = src1 + s.offset;
+            const ONSBuf* src2_buffer = src2 + s.offset;
+            ONSBuf* dst_buffer = dst + s.offset;
+            for (int j = s.length; j; --j) {
+                BLEND_MASK_PIXEL();
+                ++dst_buffer, ++src1_buffer, ++src2_buffer;
+            }
+        }
+    }
+    SDL_UnlockSurface(accumulation_surface);
+    SDL_UnlockSurface(effect_dst_surface);
+    SDL_UnlockSurface(effect_src_surface);
+#endif
+}
+
+
 // alphaBlendText
 // dst: ONSBuf surface (accumulation_surface)
 // txt: 8bit surface (TTF_RenderGlyph_Shaded())
@@ -455,6 +618,86 @@ void PonscripterLabel::alphaBlendText(SDL_Surface *dst_surface, SDL_Rect dst_rec
 }
 
 
+// alphaBlendText, shadowed variant
+// dst: ONSBuf surface (accumulation_surface)
+// glyph: (shadow, fill) coverage pairs from Font::render_shadow()
+void PonscripterLabel::alphaBlendText(SDL_Surface *dst_surface, SDL_Rect dst_rect,
+                                      const GlyphShadow &glyph, SDL_Color &color,
+                                      SDL_Color &shadow_color, SDL_Rect *clip)
+{
+    if (glyph.coverage.empty()) return;
+
+    int x2=0, y2=0;
+    SDL_Rect clipped_rect;
+
+    /* ---------------------------------------- */
+    /* 1st clipping */
+    if ( clip ){
+        if ( AnimationInfo::doClipping( &dst_rect, clip, &clipped_rect ) ) return;
+
+        x2 += clipped_rect.x;
+        y2 += clipped_rect.y;
+    }
+
+    /* ---------------------------------------- */
+    /* 2nd clipping */
+    SDL_Rect clip_rect = {0, 0, dst_surface->w, dst_surface->h};
+    if ( AnimationInfo::doClipping( &dst_rect, &clip_rect, &clipped_rect ) ) return;
+
+    x2 += clipped_rect.x;
+    y2 += clipped_rect.y;
+
+    /* ---------------------------------------- */
+
+    SDL_LockSurface( dst_surface );
+
+#ifdef BPP16
+    Uint32 fill_color = ((color.r >> RLOSS) << RSHIFT) |
+                        ((color.g >> GLOSS) << GSHIFT) |
+                        (color.b >> BLOSS);
+    fill_color = (fill_color | fill_color << 16) & BLENDMASK;
+    Uint32 shade_color = ((shadow_color.r >> RLOSS) << RSHIFT) |
+                         ((shadow_color.g >> GLOSS) << GSHIFT) |
+                         (shadow_color.b >> BLOSS);
+    shade_color = (shade_color | shade_color << 16) & BLENDMASK;
+    Uint32 src_color;
+#else
+    const Uint32 fill_color1 = color.r << RSHIFT | color.b;
+    const Uint32 fill_color2 = color.g << GSHIFT;
+    const Uint32 shade_color1 = shadow_color.r << RSHIFT | shadow_color.b;
+    const Uint32 shade_color2 = shadow_color.g << GSHIFT;
+    Uint32 src_color1, src_color2;
+#endif
+
+    ONSBuf *dst_buffer = (ONSBuf *)dst_surface->pixels +
+                         dst_surface->w * dst_rect.y + dst_rect.x;
+    const unsigned char *coverage = &glyph.coverage[0] +
+                                    2 * (glyph.w * y2 + x2);
+    for ( int i=dst_rect.h ; i>0 ; i-- ){
+        for ( int j=dst_rect.w ; j>0 ; j--, dst_buffer++, coverage += 2 ){
+            const unsigned char *src_buffer = coverage;
+#ifdef BPP16
+            src_color = shade_color;
+            BLEND_PIXEL8();
+            src_color = fill_color;
+#else
+            src_color1 = shade_color1;
+            src_color2 = shade_color2;
+            BLEND_PIXEL8();
+            src_color1 = fill_color1;
+            src_color2 = fill_color2;
+#endif
+            src_buffer++;
+            BLEND_PIXEL8();
+        }
+        dst_buffer += dst_surface->w - dst_rect.w;
+        coverage += 2 * (glyph.w - dst_rect.w);
+    }
+
+    SDL_UnlockSurface( dst_surface );
+}
+
+
 void PonscripterLabel::makeNegaSurface( SDL_Surface *surface, SDL_Rect &clip )
 {
     SDL_LockSurface( surface );
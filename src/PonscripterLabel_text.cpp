@@ -52,8 +52,10 @@ PonscripterLabel::drawGlyph(SDL_Surface* dst_surface, Fontinfo* info,
 
     info->font()->get_metrics(unicode, &minx, NULL, NULL, &maxy);
 
-    Glyph g = renderGlyph(info->font(), unicode, sz,
-              x + minx - floor(x + minx));
+    // The same phase for the fill on its own and with its shadow, which
+    // then share a rasterisation and a cache slot.
+    const float frac = x + minx - floor(x + minx);
+    Glyph g = renderGlyph(info->font(), unicode, sz, frac);
     bool rotate_flag = false;
 
     if (g.bitmap) {
@@ -64,33 +66,51 @@ PonscripterLabel::drawGlyph(SDL_Surface* dst_surface, Fontinfo* info,
     dst_rect.x = int(floor(x + minx));
     dst_rect.y = y + info->font()->ascent() - int(ceil(maxy));
 
-    if (shadow_flag) {
-        if (info->getRTL())
-            dst_rect.x -= shade_distance[0];
-        else
-            dst_rect.x += shade_distance[0];
-        dst_rect.y += shade_distance[1];
-    }
+    if (!g.bitmap) return;
 
-    if (g.bitmap) {
-        dst_rect.w = g.bitmap->w;
-        dst_rect.h = g.bitmap->h;
+    dst_rect.w = g.bitmap->w;
+    dst_rect.h = g.bitmap->h;
+
+    if (shadow_flag) {
+        // Shadow and fill are composited together from a single
+        // pre-rendered coverage map, so each glyph is blended (and, for
+        // text_info, copied to the surface) once rather than twice.
+        static SDL_Color shadow_color = { 0, 0, 0, 0 };
+        int sx = info->getRTL() ? -shade_distance[0] : shade_distance[0];
+        const GlyphShadow& s =
+            info->font()->render_shadow(unicode, frac, sx, shade_distance[1]);
+        SDL_Rect box = { dst_rect.x + s.left, dst_rect.y + s.top, s.w, s.h };
 
         if (cache_info == &text_info) {
-            // When rendering text
-            cache_info->blendText(g.bitmap, dst_rect.x, dst_rect.y,
-                                  color, clip);
-            cache_info->blendOnSurface(dst_surface, 0, 0, dst_rect);
+            cache_info->blendText(s, box.x, box.y, color, shadow_color, clip);
+            cache_info->blendOnSurface(dst_surface, 0, 0, box);
         }
         else {
             if (cache_info)
-                cache_info->blendText(g.bitmap, dst_rect.x, dst_rect.y,
-                                      color, clip);
+                cache_info->blendText(s, box.x, box.y, color, shadow_color,
+                                      clip);
 
             if (dst_surface)
-                alphaBlendText(dst_surface, dst_rect, g.bitmap, color, clip,
-                               rotate_flag);
+                alphaBlendText(dst_surface, box, s, color, shadow_color,
+                               clip);
         }
+        return;
+    }
+
+    if (cache_info == &text_info) {
+        // When rendering text
+        cache_info->blendText(g.bitmap, dst_rect.x, dst_rect.y,
+                              color, clip);
+        cache_info->blendOnSurface(dst_surface, 0, 0, dst_rect);
+    }
+    else {
+        if (cache_info)
+            cache_info->blendText(g.bitmap, dst_rect.x, dst_rect.y,
+                                  color, clip);
+
+        if (dst_surface)
+            alphaBlendText(dst_surface, dst_rect, g.bitmap, color, clip,
+                           rotate_flag);
     }
 }
 
@@ -157,17 +177,11 @@ PonscripterLabel::drawChar(const char* text, Fontinfo* info, bool flush_flag,
 
         SDL_Color color;
         SDL_Rect  dst_rect;
-        if (info->is_shadow) {
-            color.r = color.g = color.b = 0;
-            drawGlyph(surface, info, color, unicode, x, y, true, cache_info,
-              clip, dst_rect);
-        }
-
         color.r = info->color.r;
         color.g = info->color.g;
         color.b = info->color.b;    
-        drawGlyph(surface, info, color, unicode, x, y, false, cache_info,
-          clip, dst_rect);
+        drawGlyph(surface, info, color, unicode, x, y, info->is_shadow,
+                  cache_info, clip, dst_rect);
 
     info->addShadeArea(dst_rect, shade_distance);
         if (surface == accumulation_surface && !flush_flag
@@ -657,7 +671,10 @@ int PonscripterLabel::processText()
                 return RET_CONTINUE | RET_NOREAD;
             }
             else {
-                if (!flag && in_skip) {
+                if (fastForwarding()) {
+                    t = 0;
+                }
+                else if (!flag && in_skip) {
                     //Mion: instead of skipping entirely, let's do a shortened wait (safer)
                     if (t > 100) {
                         t = t / 10;
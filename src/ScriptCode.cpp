@@ -0,0 +1,239 @@
+/* -*- C++ -*-
+ *
+ *  ScriptCode.cpp - Pre-tokenised form of a Ponscripter script
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+#include "ScriptCode.h"
+#include <string.h>
+
+// Bump this whenever the tokeniser or the cache layout changes.
+static const char cache_magic[8] = { 'P', 'S', 'C', 'O', 'D', 'E', 0, 1 };
+
+static inline bool is_ident_start(char ch)
+{
+    return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || ch == '_';
+}
+
+static inline bool is_ident(char ch)
+{
+    return is_ident_start(ch) || (ch >= '0' && ch <= '9');
+}
+
+static bool by_offset(const ScriptCode::Token& a, const ScriptCode::Token& b)
+{
+    return a.offset < b.offset;
+}
+
+
+void ScriptCode::clear()
+{
+    tokens.clear();
+    name_list.clear();
+    name_ids.clear();
+    hint = 0;
+}
+
+
+int ScriptCode::intern(const pstring& name)
+{
+    dictionary<pstring, int>::t::iterator i = name_ids.find(name);
+    if (i != name_ids.end()) return i->second;
+    int id = name_list.size();
+    name_list.push_back(name);
+    name_ids[name] = id;
+    return id;
+}
+
+
+void ScriptCode::add(int offset, int type, int length, int name)
+{
+    if (length > 0x7fff) return;
+
+    Token t;
+    t.offset = offset;
+    t.type = type;
+    t.length = length;
+    t.name = name;
+    tokens.push_back(t);
+}
+
+
+void ScriptCode::compile(const char* script, int length, char text_marker)
+{
+    clear();
+
+    const char* p = script;
+    const char* end = script + length;
+    pstring ident;
+    bool statement = true;
+    while (p < end) {
+        char ch = *p;
+        if (ch == ' ' || ch == '\t') {
+            ++p;
+        }
+        else if (ch == 0x0a) {
+            statement = true;
+            ++p;
+        }
+        else if (ch == ';' || (statement && (ch & 0x80))) {
+            // Comments, and unmarked text, run to the end of the line.
+            while (p < end && *p != 0x0a) ++p;
+        }
+        else if (ch == '"' || ch == text_marker) {
+            ++p;
+            while (p < end && *p != ch && *p != 0x0a) ++p;
+            if (p < end && *p == ch) ++p;
+            statement = false;
+        }
+        else if (ch == ':') {
+            statement = true;
+            ++p;
+        }
+        else if (ch == '*') {
+            // A label reference; the name is tokenised separately too,
+            // since '*' may equally be multiplication.
+            const char* q = p + 1;
+            while (*q == ' ' || *q == '\t') ++q;
+            const char* start = q;
+            ident.trunc(0);
+            while (is_ident(*q)) {
+                ch = *q++;
+                if (ch >= 'A' && ch <= 'Z') ch += 'a' - 'A';
+                ident += ch;
+            }
+            if (q > start)
+                add(p - script, Label, q - p, intern(ident));
+            p = start;
+            statement = false;
+        }
+        else if (is_ident_start(ch)) {
+            const char* start = p;
+            ident.trunc(0);
+            while (is_ident(*p)) {
+                ch = *p++;
+                if (ch >= 'A' && ch <= 'Z') ch += 'a' - 'A';
+                ident += ch;
+            }
+            add(start - script, Identifier, p - start, intern(ident));
+            statement = false;
+        }
+        else if (ch >= '0' && ch <= '9') {
+            // Numbers, including hex, are never names.
+            while (is_ident(*p)) ++p;
+            statement = false;
+        }
+        else {
+            ++p;
+            statement = false;
+        }
+    }
+}
+
+
+const ScriptCode::Token* ScriptCode::find(int offset, int type) const
+{
+    if (tokens.empty()) return NULL;
+
+    int i = hint;
+    if (!(tokens[i].offset == offset ||
+          (++i < int(tokens.size()) && tokens[i].offset == offset) ||
+          (++i < int(tokens.size()) && tokens[i].offset == offset))) {
+        Token key;
+        key.offset = offset;
+        std::vector<Token>::const_iterator t =
+            std::lower_bound(tokens.begin(), tokens.end(), key, by_offset);
+        if (t == tokens.end() || t->offset != offset) return NULL;
+        i = t - tokens.begin();
+    }
+    hint = i;
+    return tokens[i].type == type ? &tokens[i] : NULL;
+}
+
+
+pstring ScriptCode::hash(const char* script, int length)
+{
+    // Two independent 32-bit hashes (FNV-1a and djb2) and the length.
+    unsigned int fnv = 2166136261u, djb = 5381;
+    for (int i = 0; i < length; ++i) {
+        unsigned char c = script[i];
+        fnv = (fnv ^ c) * 16777619u;
+        djb = djb * 33 + c;
+    }
+    pstring key;
+    key.format("%08x%08x%08x", fnv, djb, length);
+    return key;
+}
+
+
+bool ScriptCode::load(FILE* fp, const pstring& key)
+{
+    clear();
+
+    char magic[8];
+    int key_len, count;
+    if (fread(magic, 1, 8, fp) != 8 || memcmp(magic, cache_magic, 8) ||
+        fread(&key_len, sizeof(int), 1, fp) != 1 || key_len != key.length())
+        return false;
+    std::vector<char> buf(key_len + 1);
+    if (fread(&buf[0], 1, key_len, fp) != size_t(key_len) ||
+        memcmp(&buf[0], (const char*) key, key_len))
+        return false;
+
+    if (fread(&count, sizeof(int), 1, fp) != 1 || count < 0) return false;
+    for (int i = 0; i < count; ++i) {
+        int len;
+        if (fread(&len, sizeof(int), 1, fp) != 1 || len < 0) goto fail;
+        if (int(buf.size()) < len + 1) buf.resize(len + 1);
+        if (fread(&buf[0], 1, len, fp) != size_t(len)) goto fail;
+        intern(pstring(&buf[0], len));
+    }
+
+    if (fread(&count, sizeof(int), 1, fp) != 1 || count < 0) goto fail;
+    tokens.resize(count);
+    if (count && fread(&tokens[0], sizeof(Token), count, fp) != size_t(count))
+        goto fail;
+    for (int i = 0; i < count; ++i)
+        if (tokens[i].name < 0 || tokens[i].name >= names()) goto fail;
+
+    return true;
+
+fail:
+    clear();
+    return false;
+}
+
+
+void ScriptCode::save(FILE* fp, const pstring& key) const
+{
+    int len = key.length();
+    fwrite(cache_magic, 1, 8, fp);
+    fwrite(&len, sizeof(int), 1, fp);
+    fwrite((const char*) key, 1, len, fp);
+
+    int count = name_list.size();
+    fwrite(&count, sizeof(int), 1, fp);
+    for (int i = 0; i < count; ++i) {
+        len = name_list[i].length();
+        fwrite(&len, sizeof(int), 1, fp);
+        fwrite((const char*) name_list[i], 1, len, fp);
+    }
+
+    count = tokens.size();
+    fwrite(&count, sizeof(int), 1, fp);
+    if (count) fwrite(&tokens[0], sizeof(Token), count, fp);
+}
@@ -0,0 +1,85 @@
+/* -*- C++ -*-
+ *
+ *  ScriptCode.h - Pre-tokenised form of a Ponscripter script
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+#ifndef __SCRIPT_CODE_H__
+#define __SCRIPT_CODE_H__
+
+#include "defs.h"
+
+// The script is still executed from its text, since commands read
+// their own arguments however they see fit; but every command name,
+// bareword and label reference outside text and string literals is
+// found once, when the script is loaded, and recorded here by its
+// offset in the script buffer.  The parser can then take the name
+// from here rather than lexing and lowercasing it again each time the
+// statement runs.  Anything that isn't here is simply lexed as before.
+//
+// Names are interned, so that anything keyed by name (aliases, labels,
+// commands) can be resolved once per name and kept in a plain array.
+class ScriptCode {
+public:
+    enum { Identifier = 0, // [A-Za-z_][A-Za-z0-9_]*, lowercased
+           Label      = 1  // '*' followed by an identifier
+    };
+    struct Token {
+        int offset; // of the first byte in the script buffer
+        short type;
+        short length; // bytes of script text the token covers
+        int name;   // interned lowercase identifier
+    };
+
+    ScriptCode() : hint(0) {}
+
+    void clear();
+
+    // Tokenises the whole script.  text_marker is the encoding's text
+    // delimiter; text between markers is not tokenised.
+    void compile(const char* script, int length, char text_marker);
+
+    // The disk cache is keyed by a hash of the script text, so a
+    // stale cache is never loaded.
+    static pstring hash(const char* script, int length);
+    bool load(FILE* fp, const pstring& key);
+    void save(FILE* fp, const pstring& key) const;
+
+    // Returns the token starting at offset, or NULL.  Tokens are
+    // usually asked for in script order, so the last one found is
+    // tried first.
+    const Token* find(int offset, int type) const;
+
+    int names() const { return name_list.size(); }
+    const pstring& name(int id) const { return name_list[id]; }
+    int lookup(const pstring& name) const {
+        dictionary<pstring, int>::t::const_iterator i = name_ids.find(name);
+        return i == name_ids.end() ? -1 : i->second;
+    }
+    int size() const { return tokens.size(); }
+
+private:
+    int intern(const pstring& name);
+    void add(int offset, int type, int length, int name);
+
+    std::vector<Token> tokens; // sorted by offset
+    std::vector<pstring> name_list;
+    dictionary<pstring, int>::t name_ids;
+    mutable int hint;
+};
+
+#endif // __SCRIPT_CODE_H__
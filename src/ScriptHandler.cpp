@@ -38,7 +38,6 @@
 #include <CoreFoundation/CoreFoundation.h>
 #endif
 
-#define TMP_SCRIPT_BUF_LEN 4096
 #define STRING_BUFFER_LENGTH 2048
 
 #define SKIP_SPACE(p) while (*(p) == ' ' || *(p) == '\t') (p)++
@@ -60,7 +59,11 @@ ScriptHandler::ScriptHandler()
     utf_encoding = NULL;
     raw_script_buffer = NULL;
     script_buffer = NULL;
-    kidoku_buffer = NULL;
+    script_buffer_length = script_buffer_capacity = 0;
+    kidoku_loaded = kidoku_rewrite = false;
+    alias_generation = 1;
+    current_command = -1;
+    label_hint = -1;
     label_log.filename = "NScrllog.dat";
     file_log.filename  = "NScrflog.dat";
     clickstr_list.clear();
@@ -91,7 +94,6 @@ ScriptHandler::~ScriptHandler()
 {
     reset();
     if (script_buffer) delete[] script_buffer;
-    if (kidoku_buffer) delete[] kidoku_buffer;
     if (utf_encoding != file_encoding) delete utf_encoding;
 }
 
@@ -101,6 +103,7 @@ void ScriptHandler::reset()
     for (int i = 0; i < VARIABLE_RANGE; i++)
         variable_data[i].reset(true);
     extended_variable_data.clear();
+    extended_variable_slots.clear();
 
     arrays.clear();
 
@@ -111,6 +114,7 @@ void ScriptHandler::reset()
     // reset aliases
     num_aliases.clear();
     str_aliases.clear();
+    ++alias_generation;
 
     // reset misc. variables
     end_status = END_NONE;
@@ -207,9 +211,11 @@ const char* ScriptHandler::readToken(bool no_kidoku)
     current_variable.type = VAR_NONE;
 
     text_flag = false;
+    current_command = -1;
 
     SKIP_SPACE(buf);
-    if (!no_kidoku) markAsKidoku(buf);
+    // Only text counts towards the read-text history.
+    if (!no_kidoku) skip_enabled = true;
     
 readTokenTop:
     string_buffer.trunc(0);
@@ -228,6 +234,7 @@ readTokenTop:
              || ch == '[' || ch == '('
              || ch == '!' || ch == '#' || ch == ',' || ch == '"') {
         // text
+        if (!no_kidoku) markAsKidoku(buf);
         if (ch != '!' and !warned_unmarked) {
 //            errorWarning("unmarked text found"); //Mion: stop warnings, for compatibility
             // TODO: make this more robust; permit only !-directives
@@ -284,12 +291,13 @@ readTokenTop:
                ch != file_encoding->TextMarker()) /*nop*/;
         if (ch == 0x0a && !(textgosub_flag && linepage_flag)) {
             string_buffer += ch;
-            if (!no_kidoku) markAsKidoku(buf++);
+            buf++;
         }
 
         text_flag = true;
     }
     else if (ch == file_encoding->TextMarker()) {
+        if (!no_kidoku) markAsKidoku(buf);
         ch = *++buf;
         while (ch != file_encoding->TextMarker() && ch != 0x0a && ch != '\0') {
             if ((ch == '\\' || ch == '@') &&
@@ -343,7 +351,7 @@ readTokenTop:
 
         if (ch == 0x0a && !(textgosub_flag && linepage_flag)) {
             string_buffer += ch;
-            if (!no_kidoku) markAsKidoku(buf++);
+            buf++;
         }
 
         text_flag   = true;
@@ -351,7 +359,13 @@ readTokenTop:
     else if ((ch >= 'a' && ch <= 'z')
              || (ch >= 'A' && ch <= 'Z')
              || ch == '_') { // command
-        do {
+        const ScriptCode::Token* t = token(buf, ScriptCode::Identifier);
+        if (t) {
+            string_buffer = code.name(t->name);
+            current_command = t->name;
+            buf += t->length;
+        }
+        else do {
             if (ch >= 'A' && ch <= 'Z') ch += 'a' - 'A';
 
             string_buffer += ch;
@@ -367,7 +381,7 @@ readTokenTop:
     }
     else if (ch == '~' || ch == 0x0a || ch == ':') {
         string_buffer += ch;
-        if (!no_kidoku) markAsKidoku(buf++);
+        buf++;
     }
     else if (ch != '\0') {
         fprintf(stderr, "readToken: skip unknown heading character %c (%x)\n",
@@ -540,54 +554,49 @@ const char* ScriptHandler::getAddress(int offset)
 
 int ScriptHandler::getLineByAddress(const char* address, bool absolute)
 {
-    LabelInfo label = getLabelByAddress(address);
+    LabelInfo::iterator label = findLabelByAddress(address);
 
-    const char* addr = label.label_header;
-    int line = absolute ? label.start_line + 1 : 0;
-    while (address > addr) {
-        if (*addr == 0x0a) line++;
+    const char* addr = label->label_header;
+    int line = absolute ? label->start_line + 1 : 0;
+    if (address > script_buffer + script_buffer_length ||
+        address < script_buffer) {
+        // Not in the script proper, so not in the line index.
+        while (address > addr) {
+            if (*addr == 0x0a) line++;
 
-        addr++;
+            addr++;
+        }
+        return line;
     }
+
+    if (address > addr) line += lineOf(address) - lineOf(addr);
     return line;
 }
 
 
 const char* ScriptHandler::getAddressByLine(int line)
 {
-    LabelInfo label = getLabelByLine(line);
+    LabelInfo::iterator label = findLabelByLine(line);
 
-    int l = line - label.start_line;
-    const char* addr = label.label_header;
-    while (l > 0) {
-        while (*addr != 0x0a) addr++;
-        addr++;
-        l--;
-    }
-    return addr;
+    int l = line - label->start_line;
+    if (l <= 0) return label->label_header;
+
+    std::vector<int>::size_type i = lineOf(label->label_header) + l;
+    if (i >= line_starts.size())
+        return script_buffer + script_buffer_length;
+    return script_buffer + line_starts[i];
 }
 
 
 ScriptHandler::LabelInfo ScriptHandler::getLabelByAddress(const char* address)
 {
-    LabelInfo::vec::size_type i;
-    for (i = 0; i < label_info.size() - 1; i++) {
-        if (label_info[i + 1].start_address > address)
-            return label_info[i];
-    }
-    return label_info[i];
+    return *findLabelByAddress(address);
 }
 
 
 ScriptHandler::LabelInfo ScriptHandler::getLabelByLine(int line)
 {
-    LabelInfo::vec::size_type i;
-    for (i = 0; i < label_info.size() - 1; i++) {
-        if (label_info[i + 1].start_line > line)
-            return label_info[i];
-    }
-
-    return label_info[i];
+    return *findLabelByLine(line);
 }
 
 
@@ -635,20 +644,52 @@ bool ScriptHandler::isKidoku()
 }
 
 
+// The statement a bit of kidoku_read belongs to.
+int ScriptHandler::findKidokuStatement(int bit) const
+{
+    int lo = 0, hi = kidoku_statements.size();
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (kidoku_statements[mid].first <= bit) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo - 1;
+}
+
+
+int ScriptHandler::findTextStatement(const char* address) const
+{
+    int offset = address - script_buffer;
+    int lo = 0, hi = kidoku_statements.size();
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (kidoku_statements[mid].offset <= offset) lo = mid + 1;
+        else hi = mid;
+    }
+    if (lo == 0 || offset >= kidoku_statements[lo - 1].end) return -1;
+    return lo - 1;
+}
+
+
 void ScriptHandler::markAsKidoku(const char* address)
 {
     if (!kidokuskip_flag) return;
 
-    int offset = current_script - script_buffer;
-    if (address) offset = address - script_buffer;
-
-    //printf("mark (%c)%x:%x = %d\n", *current_script, offset /8, offset%8, kidoku_buffer[ offset/8 ] & ((char)1 << (offset % 8)));
-    if (kidoku_buffer[offset / 8] & ((char) 1 << (offset % 8)))
-        skip_enabled = true;
-    else
+    // Text the history doesn't know of is never skipped.
+    if (!address) address = current_script;
+    int id = findTextStatement(address);
+    if (id < 0) {
         skip_enabled = false;
+        return;
+    }
 
-    kidoku_buffer[offset / 8] |= ((char) 1 << (offset % 8));
+    const KidokuStatement& st = kidoku_statements[id];
+    int bit = st.first + (address - script_buffer - st.offset);
+    skip_enabled = kidoku_read[bit];
+    if (!skip_enabled) {
+        kidoku_read[bit] = true;
+        kidoku_unsaved.push_back(bit);
+    }
 }
 
 
@@ -658,32 +699,119 @@ void ScriptHandler::setKidokuskip(bool kidokuskip_flag)
 }
 
 
+// kidoku.dat is this header followed by an entry for each text token
+// read, in the order they were read: the key of its statement and its
+// offset in the statement, three ints in all.  Version 1 files had only
+// the key, for the first token of each statement.
+static const char kidoku_magic[8] = { 'P', 'S', 'K', 'I', 'D', 'O', 'K', 2 };
+
 void ScriptHandler::saveKidokuData()
 {
+    if (!kidoku_rewrite && kidoku_unsaved.empty()) return;
+
     FILE* fp;
     pstring fnam = "kidoku.dat";
-    if ((fp = fileopen(fnam, "wb", true, true)) == NULL) {
+    if ((fp = fileopen(fnam, kidoku_rewrite ? "wb" : "ab", true, true))
+        == NULL) {
         fprintf(stderr, "can't write kidoku.dat\n");
         return;
     }
 
-    fwrite(kidoku_buffer, 1, script_buffer_length / 8, fp);
+    if (kidoku_rewrite) {
+        fwrite(kidoku_magic, 1, 8, fp);
+        if (!kidoku_foreign.empty())
+            fwrite(&kidoku_foreign[0], sizeof(unsigned int),
+                   kidoku_foreign.size(), fp);
+        kidoku_unsaved.clear();
+        for (int bit = 0; bit < int(kidoku_read.size()); ++bit)
+            if (kidoku_read[bit]) kidoku_unsaved.push_back(bit);
+    }
+    for (unsigned int i = 0; i < kidoku_unsaved.size(); ++i) {
+        const int bit = kidoku_unsaved[i];
+        const KidokuStatement& st =
+            kidoku_statements[findKidokuStatement(bit)];
+        unsigned int entry[3] = { st.key[0], st.key[1],
+                                  unsigned(bit - st.first) };
+        fwrite(entry, sizeof(unsigned int), 3, fp);
+    }
     fclose(fp);
+
+    kidoku_unsaved.clear();
+    kidoku_rewrite = false;
 }
 
 
 void ScriptHandler::loadKidokuData()
 {
-    FILE* fp;
-    pstring fnam = "kidoku.dat";
     setKidokuskip(true);
-    kidoku_buffer = new char[script_buffer_length / 8 + 1];
-    memset(kidoku_buffer, 0, script_buffer_length / 8 + 1);
+    if (kidoku_loaded) return; // a reset doesn't forget what was read
 
-    if ((fp = fileopen(fnam, "rb", true, true)) != NULL) {
-        fread(kidoku_buffer, 1, script_buffer_length / 8, fp);
-        fclose(fp);
+    kidoku_loaded = true;
+    int size = 0;
+    if (!kidoku_statements.empty()) {
+        const KidokuStatement& st = kidoku_statements.back();
+        size = st.first + st.end - st.offset;
     }
+    kidoku_read.assign(size, false);
+    kidoku_unsaved.clear();
+    kidoku_foreign.clear();
+    kidoku_rewrite = true;
+
+    FILE* fp;
+    pstring fnam = "kidoku.dat";
+    if ((fp = fileopen(fnam, "rb", true, true)) == NULL) return;
+
+    char magic[8];
+    size_t got = fread(magic, 1, 8, fp);
+    if (got == 8 && !memcmp(magic, kidoku_magic, 7) &&
+        (magic[7] == 1 || magic[7] == 2)) {
+        textcount_t ids;
+        for (int i = 0; i < int(kidoku_statements.size()); ++i)
+            ids[std::make_pair(kidoku_statements[i].key[0],
+                               kidoku_statements[i].key[1])] = i;
+
+        // Version 1 files are carried over to version 2 on the next save.
+        const int ints = magic[7] == 1 ? 2 : 3;
+        unsigned int entry[3] = { 0, 0, 0 };
+        while (fread(entry, sizeof(unsigned int), ints, fp) == size_t(ints)) {
+            textcount_t::iterator i =
+                ids.find(std::make_pair(entry[0], entry[1]));
+            const KidokuStatement* st =
+                i != ids.end() ? &kidoku_statements[i->second] : NULL;
+            if (st && entry[2] < unsigned(st->end - st->offset)) {
+                kidoku_read[st->first + entry[2]] = true;
+            }
+            else {
+                kidoku_foreign.push_back(entry[0]);
+                kidoku_foreign.push_back(entry[1]);
+                kidoku_foreign.push_back(entry[2]);
+            }
+        }
+        // A partial entry at the end means an interrupted write, which
+        // the next save clears up.
+        fseek(fp, 0, SEEK_END);
+        kidoku_rewrite = magic[7] == 1 ||
+                         (ftell(fp) - 8) % (ints * sizeof(unsigned int)) != 0;
+    }
+    else {
+        // The old format: a bit for every byte of the script, set where
+        // each text token read starts.  It can only be carried over if
+        // the script is the same size.
+        std::vector<unsigned char> bits(script_buffer_length / 8 + 1, 0);
+        fseek(fp, 0, SEEK_SET);
+        size_t len = fread(&bits[0], 1, bits.size(), fp);
+        if (len == size_t(script_buffer_length / 8)) {
+            for (int i = 0; i < int(kidoku_statements.size()); ++i) {
+                const KidokuStatement& st = kidoku_statements[i];
+                for (int offset = st.offset; offset < st.end; ++offset)
+                    if (bits[offset / 8] & (1 << (offset % 8)))
+                        kidoku_read[st.first + offset - st.offset] = true;
+            }
+        }
+        else fprintf(stderr, "kidoku.dat is for a different script; "
+                     "starting a new read-text history\n");
+    }
+    fclose(fp);
 }
 
 
@@ -762,73 +890,118 @@ pstring ScriptHandler::stringFromInteger(int no, int num_column,
 }
 
 
-int ScriptHandler::readScriptSub(FILE* fp, char** buf, int encrypt_mode, bool is_utf)
+// Undoes the light encryption of nscript.dat (mode 1), nscr_sec.dat
+// (mode 2) and keyed .___ scripts (mode 3).
+static void decrypt(unsigned char* p, size_t n, int encrypt_mode,
+                    const unsigned char* key_table)
 {
-    unsigned char magic[5] = { 0x79, 0x57, 0x0d, 0x80, 0x04 };
-    int  magic_counter = 0;
-    bool cr_flag = false;
-    int bom_check = 0;
-
-    if (encrypt_mode == 3 && !key_table_flag)
-        errorAndExit("readScriptSub: the EXE file must be specified with --key-exe option.");
+    if (encrypt_mode == 1) {
+        for (size_t i = 0; i < n; ++i) p[i] ^= 0x84;
+    }
+    else if (encrypt_mode == 2) {
+        static const unsigned char magic[5] = { 0x79, 0x57, 0x0d, 0x80, 0x04 };
+        size_t i = 0;
+        for (; i + 5 <= n; i += 5) {
+            p[i]     ^= magic[0];
+            p[i + 1] ^= magic[1];
+            p[i + 2] ^= magic[2];
+            p[i + 3] ^= magic[3];
+            p[i + 4] ^= magic[4];
+        }
+        for (int j = 0; i < n; ++i, ++j) p[i] ^= magic[j];
+    }
+    else if (encrypt_mode == 3) {
+        unsigned char table[256];
+        for (int i = 0; i < 256; ++i) table[i] = key_table[i] ^ 0x84;
+        for (size_t i = 0; i < n; ++i) p[i] = table[p[i]];
+    }
+}
 
-    size_t len = 0, count = 0;
-    while (1) {
-        if (len == count) {
-            len = fread(tmp_script_buf, 1, TMP_SCRIPT_BUF_LEN, fp);
-            if (len == 0) {
-                if (cr_flag) *(*buf)++ = 0x0a;
 
-                break;
-            }
+// Turns CRLF and lone CRs into LF in place.  Returns the new length.
+static size_t normalise_newlines(char* p, size_t n)
+{
+    char* const end = p + n;
+    char* in = (char*) memchr(p, 0x0d, n);
+    if (!in) return n;
+
+    char* out = in;
+    while (in < end) {
+        // in is at a CR.
+        if (++in == end || *in != 0x0a) *out++ = 0x0a;
+        char* next = (char*) memchr(in, 0x0d, end - in);
+        if (!next) next = end;
+        memmove(out, in, next - in);
+        out += next - in;
+        in = next;
+    }
+    return out - p;
+}
 
-            count = 0;
-        }
 
-        char ch = tmp_script_buf[count++];
-        if (encrypt_mode == 1) ch ^= 0x84;
-        else if (encrypt_mode == 2) {
-            ch = (ch ^ magic[magic_counter++]) & 0xff;
-            if (magic_counter == 5) magic_counter = 0;
-        }
-        else if (encrypt_mode == 3) {
-            ch = key_table[(unsigned char) ch] ^ 0x84;
-        }
-
-        if (cr_flag && ch != 0x0a) {
-            *(*buf)++    = 0x0a;
-            cr_flag = false;
+// Removes UTF-8 byte order marks in place, wherever they are.  Returns
+// the new length.  A mark that starts inside a failed match (EF EF BB
+// BF, EF BB EF BB BF) is kept, as it always has been.
+static size_t strip_boms(char* p, size_t n)
+{
+    const unsigned char* const end = (const unsigned char*) p + n;
+    const unsigned char* in = (const unsigned char*) p;
+    const unsigned char* scan = in;
+    char* out = p;
+    while (const unsigned char* ef =
+           (const unsigned char*) memchr(scan, 0xef, end - scan)) {
+        if (end - ef >= 3 && ef[1] == 0xbb && ef[2] == 0xbf) {
+            memmove(out, in, ef - in);
+            out += ef - in;
+            in = scan = ef + 3;
         }
+        else if (end - ef >= 2 && ef[1] == 0xef)
+            scan = ef + 2;
+        else if (end - ef >= 3 && ef[1] == 0xbb && ef[2] == 0xef)
+            scan = ef + 3;
+        else
+            scan = ef + 1;
+    }
+    memmove(out, in, end - in);
+    return out + (end - in) - p;
+}
 
-        if (ch == 0x0d) {
-            cr_flag = true;
-            continue;
-        }
 
-        if (ch == 0x0a) {
-            *(*buf)++    = 0x0a;
-            cr_flag = false;
-        }
-        else {
-            *(*buf)++ = ch;
-        }
+// Appends a whole script file to the script buffer, growing it as
+// needed, and decodes it there: the file is read with a single fread
+// and each stage is a pass over the whole of it.
+int ScriptHandler::readScriptSub(FILE* fp, int encrypt_mode, bool is_utf)
+{
+    if (encrypt_mode == 3 && !key_table_flag)
+        errorAndExit("readScriptSub: the EXE file must be specified with --key-exe option.");
 
-        if (is_utf) {
-            //check for UTF-8 BOM and skip it
-            if ((ch == char(0xef)) && (bom_check == 0))
-                bom_check = 1;
-            else if ((ch == char(0xbb)) && (bom_check == 1))
-                bom_check = 2;
-            else if ((ch == char(0xbf)) && (bom_check == 2)) {
-                //fprintf(stderr,"readScriptSub: found UTF-8 BOM, backtracking\n");
-                *buf -= 3;
-                bom_check = 0;
-            } else
-                bom_check = 0;
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    if (size < 0) size = 0;
+
+    // Room for the file, the newline that ends it and a terminator.
+    if (script_buffer_length + size + 2 > script_buffer_capacity) {
+        int capacity = script_buffer_capacity * 2;
+        if (capacity < script_buffer_length + size + 2)
+            capacity = script_buffer_length + size + 2;
+        char* buf = new char[capacity];
+        if (raw_script_buffer) {
+            memcpy(buf, raw_script_buffer, script_buffer_length);
+            delete[] raw_script_buffer;
         }
-    }
-
-    *(*buf)++ = 0x0a;
+        raw_script_buffer = buf;
+        script_buffer_capacity = capacity;
+    }
+
+    char* p = raw_script_buffer + script_buffer_length;
+    size_t n = fread(p, 1, size, fp);
+    decrypt((unsigned char*) p, n, encrypt_mode, key_table);
+    n = normalise_newlines(p, n);
+    if (is_utf) n = strip_boms(p, n);
+    p[n++] = 0x0a;
+    p[n] = 0;
+    script_buffer_length += n;
     return 0;
 }
 
@@ -917,40 +1090,16 @@ int ScriptHandler::readScript(DirPaths *path, const char* prefer_name)
         is_ponscripter = false;
     }
     
-    fseek(fp, 0, SEEK_END);
-    int estimated_buffer_length = ftell(fp) + 1;
-
-    if (encrypt_mode == 0 && !fname) {
-        fclose(fp);
-        for (int i = 1; i < 100; i++) {
-            pstring filename;
-            filename.format("%d.%s", i, (const char*)ext);
-            if ((fp = fileopen(script_path, filename, "rb")) == NULL) {
-                filename.format("%02d.%s", i, (const char*)ext);
-                fp = fileopen(script_path, filename, "rb");
-            }
-
-            if (fp) {
-                fseek(fp, 0, SEEK_END);
-                estimated_buffer_length += ftell(fp) + 1;
-                fclose(fp);
-            }
-        }
-    }
-
     if (raw_script_buffer) delete[] raw_script_buffer;
-
-    char* p_script_buffer = new char[estimated_buffer_length];
-
-    current_script = raw_script_buffer = p_script_buffer;
-    tmp_script_buf = new char[TMP_SCRIPT_BUF_LEN];
+    raw_script_buffer = NULL;
+    script_buffer_length = script_buffer_capacity = 0;
 
     if (encrypt_mode > 0 || fname) {
-        fseek(fp, 0, SEEK_SET);
-        readScriptSub(fp, &p_script_buffer, encrypt_mode);
+        readScriptSub(fp, encrypt_mode);
         fclose(fp);
     }
     else {
+        fclose(fp);
         for (int i = 0; i < 100; i++) {
             pstring filename;
             filename.format("%d.%s", i, (const char*)ext);
@@ -960,15 +1109,13 @@ int ScriptHandler::readScript(DirPaths *path, const char* prefer_name)
             }
 
             if (fp) {
-                readScriptSub(fp, &p_script_buffer, 0, (enc == UTF8));
+                readScriptSub(fp, 0, (enc == UTF8));
                 fclose(fp);
             }
         }
     }
 
-    delete[] tmp_script_buf;
-
-    script_buffer = raw_script_buffer;
+    current_script = script_buffer = raw_script_buffer;
 
     // Search for gameid file (this overrides any builtin
     // ;gameid directive, or serves its purpose if none is available)
@@ -992,8 +1139,6 @@ int ScriptHandler::readScript(DirPaths *path, const char* prefer_name)
         }
     }
 
-    script_buffer_length = p_script_buffer - script_buffer;
-
     /* ---------------------------------------- */
     /* screen size and value check */
     const char* buf = script_buffer+1;
@@ -1091,50 +1236,557 @@ int ScriptHandler::readScript(DirPaths *path, const char* prefer_name)
 }
 
 
-int ScriptHandler::labelScript()
+// Returns where text starts in a line of script, or NULL if the line
+// has none.  Text runs to the end of the line, and may follow commands
+// after a colon; the rest of an if statement may be text, so that is
+// treated as text throughout.
+static const char* find_text(const char* buf)
+{
+    const char marker = file_encoding->TextMarker();
+    while (1) {
+        SKIP_SPACE(buf);
+        char ch = *buf;
+        if (ch & 0x80 || (ch >= '0' && ch <= '9') || ch == marker
+            || ch == '@' || ch == '\\' || ch == '/' || ch == '%' || ch == '?'
+            || ch == '$' || ch == '[' || ch == '(' || ch == '!' || ch == '#'
+            || ch == ',' || ch == '"')
+            return buf;
+
+        const char* word = buf;
+        while (isalnum(*buf) || *buf == '_') ++buf;
+        if ((buf - word == 2 && !SDL_strncasecmp(word, "if", 2)) ||
+            (buf - word == 5 && !SDL_strncasecmp(word, "notif", 5)))
+            return word;
+
+        // Skip to the next statement, if any.
+        while ((ch = *buf) != 0x0a && ch != ':' && ch != ';' && ch != '\0') {
+            if (ch == '"' || ch == marker) {
+                const char quote = ch;
+                while ((ch = *++buf) != quote && ch != 0x0a && ch != '\0')
+                    /*nop*/;
+                if (ch != quote) break;
+            }
+            ++buf;
+        }
+        if (ch != ':') return NULL;
+        ++buf;
+    }
+}
+
+
+static void hash_bytes(unsigned int* key, const char* p, int len)
+{
+    // FNV-1a and djb2, as for the script cache.
+    for (int i = 0; i < len; ++i) {
+        unsigned char c = p[i];
+        key[0] = (key[0] ^ c) * 16777619u;
+        key[1] = key[1] * 33 + c;
+    }
+}
+
+
+// Keys a text statement by its label, its text, and how often the same
+// text has come before under that label.
+void ScriptHandler::keyTextStatement(KidokuStatement& st, const char* script,
+                                     const pstring* label,
+                                     textcount_t& occurrences)
+{
+    st.key[0] = 2166136261u;
+    st.key[1] = 5381;
+    if (label) hash_bytes(st.key, *label, label->length() + 1);
+    hash_bytes(st.key, script + st.offset, st.end - st.offset);
+
+    // Repeated text is told apart by how often it has come before.
+    int n = occurrences[std::make_pair(st.key[0], st.key[1])]++;
+    char count[4] = { char(n), char(n >> 8), char(n >> 16), char(n >> 24) };
+    hash_bytes(st.key, count, 4);
+}
+
+
+// Finds the labels, lines and text statements in one piece of the
+// script.  This runs on its own thread, so it reads labels itself
+// rather than through readLabel().
+int ScriptHandler::labelChunk(void* chunk)
 {
+    LabelChunk& c = *(LabelChunk*) chunk;
+    const char* buf = c.begin;
     int current_line = 0;
-    const char* buf = script_buffer;
-    label_info.clear();
+    textcount_t occurrences;
 
-    while (buf < script_buffer + script_buffer_length) {
+    while (buf < c.end) {
         SKIP_SPACE(buf);
         if (*buf == '*') {
-            setCurrent(buf);
-            readLabel();
 	    LabelInfo new_label;
-	    new_label.name
-		= string_buffer.midstr(1, string_buffer.length() - 1);
-            new_label.label_header = buf;
+            new_label.label_header = buf++;
+            SKIP_SPACE(buf);
+            const char* name = buf;
+            while ((*buf >= 'a' && *buf <= 'z') || (*buf >= 'A' && *buf <= 'Z')
+                   || (*buf >= '0' && *buf <= '9') || *buf == '_')
+                buf++;
+            new_label.name = pstring(name, buf - name);
+            new_label.name.tolower();
             new_label.num_of_lines = 1;
             new_label.start_line = current_line;
-	    buf = getNext();
+            SKIP_SPACE(buf);
+            if (*buf == ',') {
+                buf++;
+                SKIP_SPACE(buf);
+            }
             if (*buf == 0x0a) {
                 buf++;
                 SKIP_SPACE(buf);
                 current_line++;
             }
 	    new_label.start_address = buf;
-	    label_info.push_back(new_label);
+	    c.labels.push_back(new_label);
+            occurrences.clear();
         }
         else {
-	    if (label_info.size())
-		label_info.back().num_of_lines++;
+            if (c.labels.size())
+                c.labels.back().num_of_lines++;
+            else
+                c.lines_before_label++;
 
+            const char* text = find_text(buf);
             while (*buf != 0x0a) buf++;
+            if (text) {
+                KidokuStatement st;
+                st.offset = text - c.script;
+                st.end = buf - c.script;
+                if (c.labels.empty())
+                    c.pending.push_back(st);
+                else {
+                    keyTextStatement(st, c.script, &c.labels.back().name,
+                                     occurrences);
+                    c.statements.push_back(st);
+                }
+            }
             buf++;
             current_line++;
         }
     }
+    c.occurrences.swap(occurrences);
 
-    // Index label names.
-    for (LabelInfo::iterator i = label_info.begin(); i != label_info.end(); ++i)
-	label_names[i->name] = i;
-    
+    // Index lines, for mapping between lines and addresses.
+    for (buf = c.begin; buf < c.end; ) {
+        buf = (const char*) memchr(buf, 0x0a, c.end - buf);
+        if (!buf) break;
+        c.line_starts.push_back(++buf - c.script);
+    }
+    c.lines = c.line_starts.size();
     return 0;
 }
 
 
+// Splits the script into as many pieces as there are processors to
+// work on them, each piece starting at the beginning of a line.  There
+// is one more bound than pieces.
+void ScriptHandler::splitScript(std::vector<const char*>& bounds) const
+{
+    const char* script_end = script_buffer + script_buffer_length;
+    int threads = SDL_GetCPUCount();
+    if (threads > script_buffer_length >> 20) threads = script_buffer_length >> 20;
+    if (threads > 16) threads = 16;
+    if (threads < 1) threads = 1;
+
+    bounds.assign(1, script_buffer);
+    const char* buf = script_buffer;
+    for (int i = 1; i < threads; ++i) {
+        const char* split = script_buffer + script_buffer_length / threads * i;
+        if (split > buf) buf = split;
+        const char* nl = (const char*) memchr(buf, 0x0a, script_end - buf);
+        buf = nl ? nl + 1 : script_end;
+        bounds.push_back(buf);
+    }
+    bounds.push_back(script_end);
+}
+
+
+// Runs fn on every piece, the first on this thread and the rest on
+// threads of their own.  A piece whose thread can't be created is
+// done here instead.
+template <class Piece>
+static void run_pieces(std::vector<Piece>& pieces, int (*fn)(void*),
+                       const char* name)
+{
+    std::vector<SDL_Thread*> workers(pieces.size(), (SDL_Thread*) NULL);
+    for (size_t i = 1; i < pieces.size(); ++i)
+        workers[i] = SDL_CreateThread(fn, name, &pieces[i]);
+    fn(&pieces[0]);
+    for (size_t i = 1; i < pieces.size(); ++i) {
+        if (workers[i])
+            SDL_WaitThread(workers[i], NULL);
+        else
+            fn(&pieces[i]);
+    }
+}
+
+
+int ScriptHandler::labelScript()
+{
+    std::vector<const char*> bounds;
+    splitScript(bounds);
+    const int threads = bounds.size() - 1;
+
+    std::vector<LabelChunk> chunks(threads);
+    for (int i = 0; i < threads; ++i) {
+        LabelChunk& c = chunks[i];
+        c.script = script_buffer;
+        c.begin = bounds[i];
+        c.end = bounds[i + 1];
+        c.lines = c.lines_before_label = 0;
+    }
+    run_pieces(chunks, labelChunk, "label script");
+
+    // Join the pieces up, in order.
+    label_info.clear();
+    kidoku_statements.clear();
+    kidoku_loaded = false;
+    line_starts.clear();
+    line_starts.push_back(0);
+    textcount_t occurrences; // under the last label so far
+    int line_base = 0;
+    for (int i = 0; i < threads; ++i) {
+        LabelChunk& c = chunks[i];
+        if (label_info.size())
+            label_info.back().num_of_lines += c.lines_before_label;
+
+        const pstring* label = label_info.empty() ? NULL : &label_info.back().name;
+        for (size_t j = 0; j < c.pending.size(); ++j) {
+            keyTextStatement(c.pending[j], script_buffer, label, occurrences);
+            kidoku_statements.push_back(c.pending[j]);
+        }
+
+        if (c.labels.size()) {
+            for (LabelInfo::iterator l = c.labels.begin(); l != c.labels.end(); ++l) {
+                l->start_line += line_base;
+                label_info.push_back(*l);
+            }
+            kidoku_statements.insert(kidoku_statements.end(),
+                                     c.statements.begin(), c.statements.end());
+            occurrences.swap(c.occurrences);
+        }
+
+        line_starts.insert(line_starts.end(), c.line_starts.begin(),
+                           c.line_starts.end());
+        line_base += c.lines;
+    }
+
+    int bits = 0;
+    for (size_t i = 0; i < kidoku_statements.size(); ++i) {
+        kidoku_statements[i].first = bits;
+        bits += kidoku_statements[i].end - kidoku_statements[i].offset;
+    }
+    indexLabels();
+    return 0;
+}
+
+
+static unsigned int hash_name(const char* p, int len)
+{
+    unsigned int key[2] = { 2166136261u, 5381 };
+    hash_bytes(key, p, len);
+    return key[0];
+}
+
+
+// Label names go in an open-addressing hash table, rebuilt whenever
+// the script is labelled.  Where a name is used twice the later label
+// wins, as it always has.
+void ScriptHandler::indexLabels()
+{
+    size_t size = 16;
+    while (size < label_info.size() * 2) size *= 2;
+    label_table.assign(size, -1);
+    const unsigned int mask = size - 1;
+    for (int i = 0; i < (int) label_info.size(); ++i) {
+        const pstring& name = label_info[i].name;
+        unsigned int h = hash_name(name, name.length()) & mask;
+        while (label_table[h] >= 0 && label_info[label_table[h]].name != name)
+            h = (h + 1) & mask;
+        label_table[h] = i;
+    }
+}
+
+
+static inline bool is_name_start(char ch)
+{
+    return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || ch == '_';
+}
+
+static inline bool is_name(char ch)
+{
+    return is_name_start(ch) || (ch >= '0' && ch <= '9');
+}
+
+static const char* read_name(const char* p, pstring& name)
+{
+    const char* start = p;
+    while (is_name(*p)) ++p;
+    name = pstring(start, p - start);
+    name.tolower();
+    return p;
+}
+
+static inline bool ends_statement(char ch)
+{
+    return ch == 0x0a || ch == ':' || ch == ';' || ch == '\0';
+}
+
+static const char* skip_string(const char* p)
+{
+    const char quote = *p++;
+    while (*p != quote && *p != 0x0a && *p != '\0') ++p;
+    return *p == quote ? p + 1 : p;
+}
+
+static void add_ref(std::vector<ScriptHandler::ScriptRef>& refs,
+                    ScriptHandler::ScriptRef::Kind kind, const char* script,
+                    const char* at, const pstring& name)
+{
+    ScriptHandler::ScriptRef r;
+    r.kind = kind;
+    r.offset = at - script;
+    r.name = name;
+    refs.push_back(r);
+}
+
+
+// Reads the condition of an if or notif, up to the command that
+// follows it.  Conditions alternate between operands and operators,
+// so a name where an operator should be is the command.
+static const char* scan_condition(const char* p, const char* script,
+                                  std::vector<ScriptHandler::ScriptRef>& refs)
+{
+    const char marker = file_encoding->TextMarker();
+    pstring name;
+    bool operand = true;
+    while (1) {
+        SKIP_SPACE(p);
+        const char* at = p;
+        char ch = *p;
+        if (ends_statement(ch)) return p;
+
+        if (!operand) {
+            if (ch == ')' || ch == ']') ++p;
+            else if (ch == '[') {
+                ++p;
+                operand = true;
+            }
+            else if (strchr("=!<>&|+-*/", ch)) {
+                while (*p && strchr("=!<>&|+-*/", *p)) ++p;
+                operand = true;
+            }
+            else if (is_name_start(ch)) {
+                const char* q = read_name(p, name);
+                if (name != "mod") return at;
+                p = q;
+                operand = true;
+            }
+            else return p; // text
+        }
+        else if (ch == '"' || ch == marker) {
+            p = skip_string(p);
+            operand = false;
+        }
+        else if (ch == '%' || ch == '$' || ch == '?' || ch == '*') {
+            ++p;
+            SKIP_SPACE(p);
+            if (is_name_start(*p)) {
+                p = read_name(p, name);
+                add_ref(refs, ch == '*' ? ScriptHandler::ScriptRef::Label
+                                          : ScriptHandler::ScriptRef::Alias,
+                        script, at, name);
+            }
+            else while (is_name(*p)) ++p;
+            operand = false;
+        }
+        else if (is_name_start(ch)) {
+            p = read_name(p, name);
+            if (name == "fchk" || name == "lchk") continue;
+            add_ref(refs, ScriptHandler::ScriptRef::Alias, script, at,
+                    name);
+            operand = false;
+        }
+        else if (ch >= '0' && ch <= '9') {
+            while (is_name(*p)) ++p;
+            operand = false;
+        }
+        else ++p; // '(', or a unary '-' or '!'
+    }
+}
+
+
+// Reads the arguments of a command.  Bare names may be either aliases
+// or words the command understands for itself, so they are only taken
+// for aliases where an expression demands it.
+static const char* scan_arguments(const char* p, const char* script,
+                                  std::vector<ScriptHandler::ScriptRef>& refs)
+{
+    const char marker = file_encoding->TextMarker();
+    pstring name;
+    bool operand = false;
+    while (!ends_statement(*p)) {
+        const char* at = p;
+        char ch = *p;
+        if (ch == ' ' || ch == '\t') ++p;
+        else if (ch == '"' || ch == marker) {
+            p = skip_string(p);
+            operand = false;
+        }
+        else if (ch == '%' || ch == '$' || ch == '?' || ch == '*') {
+            ++p;
+            SKIP_SPACE(p);
+            if (is_name_start(*p)) {
+                p = read_name(p, name);
+                add_ref(refs, ch == '*' ? ScriptHandler::ScriptRef::Label
+                                          : ScriptHandler::ScriptRef::Alias,
+                        script, at, name);
+                operand = false;
+            }
+            else operand = ch == '*';
+        }
+        else if (is_name_start(ch)) {
+            p = read_name(p, name);
+            if (operand)
+                add_ref(refs, ScriptHandler::ScriptRef::Alias, script, at,
+                        name);
+            operand = false;
+        }
+        else if ((ch >= '0' && ch <= '9') || ch == '#') {
+            while (is_name(*++p)) /*nop*/;
+            operand = false;
+        }
+        else {
+            operand = strchr("([+-/=<>", ch) != NULL;
+            ++p;
+        }
+    }
+    return p;
+}
+
+
+// Finds the names used and defined in one piece of the script.  Like
+// labelChunk(), this runs on its own thread.
+int ScriptHandler::scanChunk(void* chunk)
+{
+    ScanChunk& c = *(ScanChunk*) chunk;
+    pstring name, defined;
+    const char* p = c.begin;
+    while (p < c.end) {
+        SKIP_SPACE(p);
+        if (*p == '*') {
+            ++p;
+            SKIP_SPACE(p);
+            while (is_name(*p)) ++p;
+        }
+
+        // The statements on one line.
+        while (1) {
+            SKIP_SPACE(p);
+            const char* at = p;
+            char ch = *p;
+            if (ch == ':' || ch == '~') {
+                ++p;
+                continue;
+            }
+            if (!is_name_start(ch)) break; // text, comment or end of line
+
+            p = read_name(p, name);
+            add_ref(c.refs, ScriptRef::Command, c.script, at, name);
+            const char* cmd = name;
+            if (*cmd == '_') ++cmd;
+            if (!strcmp(cmd, "if") || !strcmp(cmd, "notif")) {
+                p = scan_condition(p, c.script, c.refs);
+                continue;
+            }
+
+            bool alias = !strcmp(cmd, "numalias") || !strcmp(cmd, "stralias");
+            if (alias || !strcmp(cmd, "defsub")) {
+                SKIP_SPACE(p);
+                if (is_name_start(*p)) {
+                    at = p;
+                    p = read_name(p, defined);
+                    add_ref(c.refs, alias ? ScriptRef::DefineAlias
+                                          : ScriptRef::DefineSub,
+                            c.script, at, defined);
+                }
+            }
+            p = scan_arguments(p, c.script, c.refs);
+        }
+
+        const char* nl = (const char*) memchr(p, 0x0a, c.end - p);
+        p = nl ? nl + 1 : c.end;
+    }
+    return 0;
+}
+
+
+void ScriptHandler::scanScript(std::vector<ScriptRef>& refs)
+{
+    std::vector<const char*> bounds;
+    splitScript(bounds);
+    std::vector<ScanChunk> chunks(bounds.size() - 1);
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        chunks[i].script = script_buffer;
+        chunks[i].begin = bounds[i];
+        chunks[i].end = bounds[i + 1];
+    }
+    run_pieces(chunks, scanChunk, "scan script");
+
+    refs.clear();
+    for (size_t i = 0; i < chunks.size(); ++i)
+        refs.insert(refs.end(), chunks[i].refs.begin(), chunks[i].refs.end());
+}
+
+
+void ScriptHandler::compileScript()
+{
+    // The cache lives with the saved games, which is why this isn't
+    // done by labelScript(): the save path depends on the game ID.
+    pstring key = ScriptCode::hash(script_buffer, script_buffer_length);
+    FILE* fp = fileopen("pscode.dat", "rb", true);
+    bool cached = fp && code.load(fp, key);
+    if (fp) fclose(fp);
+
+    if (!cached) {
+        code.compile(script_buffer, script_buffer_length,
+                     file_encoding->TextMarker());
+        if ((fp = fileopen("pscode.dat", "wb", true)) != NULL) {
+            code.save(fp, key);
+            fclose(fp);
+        }
+        else fprintf(stderr, "can't write pscode.dat\n");
+    }
+
+    num_alias_stamp.assign(code.names(), 0);
+    num_alias_value.assign(code.names(), 0);
+    label_by_name.assign(code.names(), -1);
+    for (LabelInfo::iterator i = label_info.begin(); i != label_info.end(); ++i) {
+        int name = code.lookup(i->name);
+        if (name >= 0) label_by_name[name] = i - label_info.begin();
+    }
+    label_hint = -1;
+}
+
+
+bool ScriptHandler::numAlias(int name, int& val)
+{
+    if (num_alias_stamp[name] != alias_generation) {
+        numalias_t::iterator a = num_aliases.find(code.name(name));
+        num_alias_stamp[name] = alias_generation;
+        num_alias_value[name] = a == num_aliases.end() ? MAX_INT : a->second;
+    }
+    val = num_alias_value[name];
+    if (val != MAX_INT) return true;
+
+    // Either no such alias, or an alias of MAX_INT; the slow path
+    // will tell which.
+    val = 0;
+    return false;
+}
+
+
 ScriptHandler::LabelInfo ScriptHandler::lookupLabel(const pstring& label)
 {
     LabelInfo::iterator i = findLabel(label);
@@ -1175,14 +1827,37 @@ ScriptHandler::VariableData &ScriptHandler::getVariableData(int no)
     if (no >= 0 && no < VARIABLE_RANGE)
         return variable_data[no];
 
-    for (size_t i=0 ; i<extended_variable_data.size() ; i++) {
-        if (extended_variable_data[i].no == no) 
-            return extended_variable_data[i].vd;
+    // Open addressing with linear probing; each slot holds an index
+    // into extended_variable_data plus one, or 0 if it is empty.
+    unsigned int mask = extended_variable_slots.size() - 1;
+    if (!extended_variable_slots.empty()) {
+        for (unsigned int h = hashVariable(no) & mask;; h = (h + 1) & mask) {
+            int i = extended_variable_slots[h];
+            if (!i) break;
+            if (extended_variable_data[i - 1].no == no)
+                return extended_variable_data[i - 1].vd;
+        }
+    }
+
+    // Keep the table no more than half full.
+    if ((extended_variable_data.size() + 1) * 2 >
+        extended_variable_slots.size()) {
+        std::vector<int>::size_type size =
+            std::max(std::vector<int>::size_type(16),
+                     extended_variable_slots.size() * 2);
+        extended_variable_slots.assign(size, 0);
+        mask = size - 1;
+        for (size_t i = 0; i < extended_variable_data.size(); ++i) {
+            unsigned int h = hashVariable(extended_variable_data[i].no) & mask;
+            while (extended_variable_slots[h]) h = (h + 1) & mask;
+            extended_variable_slots[h] = i + 1;
+        }
     }
+
     extended_variable_data.push_back(ExtendedVariableData(no));
-    //printf("SHandler.getVariableData: adding extended variable for var no %d "
-    //       "(vector size/capacity is now %d/%d\n", no, 
-    //       extended_variable_data.size(), extended_variable_data.capacity());
+    unsigned int h = hashVariable(no) & mask;
+    while (extended_variable_slots[h]) h = (h + 1) & mask;
+    extended_variable_slots[h] = extended_variable_data.size();
 
     return extended_variable_data.back().vd;
 }
@@ -1191,20 +1866,80 @@ ScriptHandler::VariableData &ScriptHandler::getVariableData(int no)
 // ----------------------------------------
 // Private methods
 
+// Labels are in script order, so both their addresses and their line
+// numbers are sorted.  Anything before the second label belongs to
+// the first.
+static bool address_before(const char* address,
+                           const ScriptHandler::LabelInfo& label)
+{
+    return address < label.start_address;
+}
+
+static bool line_before(int line, const ScriptHandler::LabelInfo& label)
+{
+    return line < label.start_line;
+}
+
+
+ScriptHandler::LabelInfo::iterator
+ScriptHandler::findLabelByAddress(const char* address)
+{
+    return std::upper_bound(label_info.begin() + 1, label_info.end(),
+                            address, address_before) - 1;
+}
+
+
+ScriptHandler::LabelInfo::iterator ScriptHandler::findLabelByLine(int line)
+{
+    return std::upper_bound(label_info.begin() + 1, label_info.end(),
+                            line, line_before) - 1;
+}
+
+
+// Returns the number of newlines before address.
+int ScriptHandler::lineOf(const char* address) const
+{
+    return std::upper_bound(line_starts.begin(), line_starts.end(),
+                            int(address - script_buffer))
+        - line_starts.begin() - 1;
+}
+
+
 ScriptHandler::LabelInfo::iterator ScriptHandler::findLabel(pstring label)
 {
-    if (label[0] == '*') label.remove(0, 1);
-    label.tolower();
+    if (label_hint >= 0) {
+        LabelInfo::iterator i = label_info.begin() + label_hint;
+        label_hint = -1;
+        const char* name = label;
+        if (*name == '*') ++name;
+        if (i->name == name) return i;
+    }
 
-    LabelInfo::dic::iterator e = label_names.find(label);
-    if (e != label_names.end())
-	return e->second;
+    int i = findLabelIndex(label);
+    if (i >= 0) return label_info.begin() + i;
 
+    if (label[0] == '*') label.remove(0, 1);
     errorAndExit("Label \"" + label + "\" is not found.");
     return label_info.end(); // dummy
 }
 
 
+// Returns the label_info index of the label, or -1.
+int ScriptHandler::findLabelIndex(pstring label) const
+{
+    if (label_table.empty()) return -1;
+    if (label[0] == '*') label.remove(0, 1);
+    label.tolower();
+
+    const unsigned int mask = label_table.size() - 1;
+    for (unsigned int h = hash_name(label, label.length()) & mask;
+         label_table[h] >= 0; h = (h + 1) & mask) {
+        if (label_info[label_table[h]].name == label) return label_table[h];
+    }
+    return -1;
+}
+
+
 const char* ScriptHandler::checkComma(const char* buf)
 {
     SKIP_SPACE(buf);
@@ -1302,6 +2037,14 @@ pstring ScriptHandler::parseStr(const char** buf)
         return s;
     }
     else if (**buf == '*') { // label
+        const ScriptCode::Token* t = token(*buf, ScriptCode::Label);
+        if (t) {
+            *buf += t->length;
+            label_hint = label_by_name[t->name];
+            current_variable.type |= VAR_CONST | VAR_LABEL;
+            return "*" + code.name(t->name);
+        }
+
         pstring s(*(*buf)++);
         SKIP_SPACE(*buf);
         char ch = **buf;
@@ -1379,7 +2122,7 @@ int ScriptHandler::parseInt(const char** buf)
         current_variable.type  = VAR_ARRAY;
 	ArrayVariable::iterator i = arrays.find(arr.first);
 	if (i != arrays.end()) {
-	    if (arr.second.size() < i->second.dimensions())
+	    if (arr.second.size() < int(i->second.dimensions()))
 		arr.second.push_back(0);
 	    return i->second.getValue(arr.second);
 	}
@@ -1387,7 +2130,6 @@ int ScriptHandler::parseInt(const char** buf)
     }
     else {
         char ch;
-	pstring alias_buf;
         int alias_no = 0;
         bool direct_num_flag = false;
         bool num_alias_flag  = false;
@@ -1395,6 +2137,18 @@ int ScriptHandler::parseInt(const char** buf)
         if (hex_num_flag) *buf += 2;
 
         const char* buf_start = *buf;
+
+        // Aliases named in the script itself were tokenised on loading.
+        const ScriptCode::Token* t;
+        if (!hex_num_flag && (isalpha(**buf) || **buf == '_') &&
+            (t = token(*buf, ScriptCode::Identifier)) &&
+            numAlias(t->name, alias_no)) {
+            *buf += t->length;
+            current_variable.type = VAR_INT | VAR_CONST;
+            SKIP_SPACE(*buf);
+            return alias_no;
+        }
+
         while (1) {
             ch = **buf;
 
@@ -1409,16 +2163,11 @@ int ScriptHandler::parseInt(const char** buf)
 
                 if (direct_num_flag)
                     alias_no = alias_no * 10 + ch - '0';
-                else
-                    alias_buf += ch;
             }
             else if (isalpha(ch) || ch == '_') {
-                if (ch >= 'A' && ch <= 'Z') ch += 'a' - 'A';
-
                 if (hex_num_flag || direct_num_flag) break;
 
                 num_alias_flag = true;
-                alias_buf += ch;
             }
             else break;
 
@@ -1433,6 +2182,9 @@ int ScriptHandler::parseInt(const char** buf)
         /* ---------------------------------------- */
         /* Solve num aliases */
         if (num_alias_flag) {
+            // Only now is the name needed as a string.
+            pstring alias_buf(buf_start, *buf - buf_start);
+            alias_buf.tolower();
 
 	    numalias_t::iterator a = num_aliases.find(alias_buf);
 	    if (a == num_aliases.end()) {
@@ -1582,8 +2334,8 @@ ScriptHandler::array_ref ScriptHandler::parseArray(const char** buf)
 
     SKIP_SPACE(*buf);
     
-    h_index_t indices;
-    
+    array_index_t indices;
+
     while (**buf == '[') {
         (*buf)++;
 	indices.push_back(parseIntExpression(buf));
@@ -1681,16 +2433,16 @@ void ScriptHandler::LogInfo::read(ScriptHandler& h)
 
 
 int&
-ScriptHandler::ArrayVariable::getoffs(const h_index_t& indices)
+ScriptHandler::ArrayVariable::getoffs(const array_index_t& indices)
 {
-    if (indices.size() != dim.size()) {
+    if (indices.size() != int(dim.size())) {
 	pstring msg;
 	msg.format("Indexed %d deep into %d-dimensional array",
 		   indices.size(), dim.size());
 	owner->errorAndExit(msg);
     }
     int offs_idx = 0;
-    for (h_index_t::size_type i = 0; i < indices.size(); ++i) {
+    for (int i = 0; i < indices.size(); ++i) {
 	if (indices[i] > dim[i])
 	    owner->errorAndExit("array index out of range");
 	offs_idx *= dim[i];
@@ -1699,11 +2451,15 @@ ScriptHandler::ArrayVariable::getoffs(const h_index_t& indices)
     return data[offs_idx];
 }
 
-ScriptHandler::ArrayVariable::ArrayVariable(ScriptHandler* o, h_index_t sizes)
-    : owner(o), dim(sizes)
+ScriptHandler::ArrayVariable::ArrayVariable(ScriptHandler* o,
+                                            const array_index_t& sizes)
+    : owner(o)
 {
     int sz = 1;
-    for (h_index_t::iterator i = dim.begin(); i != dim.end(); ++i) sz *= ++(*i);
+    for (int i = 0; i < sizes.size(); ++i) {
+        dim.push_back(sizes[i] + 1);
+        sz *= dim.back();
+    }
     data.assign(sz, 0);
 }
 
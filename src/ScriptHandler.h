@@ -30,6 +30,7 @@
 #include "BaseReader.h"
 #include "DirPaths.h"
 #include "expression.h"
+#include "ScriptCode.h"
 
 const int VARIABLE_RANGE = 4096;
 
@@ -70,13 +71,13 @@ public:
 	typedef std::map<int, ArrayVariable> map;
 	typedef map::iterator iterator;
 
-	int  getValue(const h_index_t& i)          { return getoffs(i); }
-	void setValue(const h_index_t& i, int val) { getoffs(i) = val; }
+	int  getValue(const array_index_t& i)          { return getoffs(i); }
+	void setValue(const array_index_t& i, int val) { getoffs(i) = val; }
 
 	h_index_t::size_type dimensions() const { return dim.size(); }
 	int dimension_size(int depth)   const { return dim[depth]; }
 	
-	ArrayVariable(ScriptHandler* o, h_index_t sizes);
+	ArrayVariable(ScriptHandler* o, const array_index_t& sizes);
 
 	h_index_t::iterator begin() { return data.begin(); }
 	h_index_t::iterator end()   { return data.end(); }
@@ -84,7 +85,7 @@ public:
 	ScriptHandler* owner;
         h_index_t dim;
 	h_index_t data;
-	int& getoffs(const h_index_t& indices);
+	int& getoffs(const array_index_t& indices);
     };
     ArrayVariable::map arrays;
 
@@ -99,7 +100,7 @@ public:
     struct VariableInfo {
         int type;
         int var_no;   // for integer(%), array(?), string($) variable
-        h_index_t array; // for array(?)
+        array_index_t array; // for array(?)
 	VariableInfo() {}
     };
 
@@ -157,6 +158,13 @@ public:
     }
     void addStrBuf(char ch) { string_buffer += ch; }
 
+    // The interned name of the command just read by readToken, or -1
+    // if it wasn't one from the token table.  Names are numbered from
+    // 0 to getNames() - 1 and last as long as the script.
+    int getCommand() const { return current_command; }
+    const pstring& getName(int id) const { return code.name(id); }
+    int getNames() const { return code.names(); }
+
     // function for direct manipulation of script address
     inline const char* getCurrent() { return current_script; };
     inline const char* getNext() { return next_script; };
@@ -209,19 +217,34 @@ public:
     pstring stringFromInteger(int no, int num_column,
 			     bool is_zero_inserted = false, bool do_wide = false);
     
-    int readScriptSub(FILE* fp, char** buf, int encrypt_mode, bool is_utf=false);
+    int readScriptSub(FILE* fp, int encrypt_mode, bool is_utf=false);
     int readScript(DirPaths *path, const char* prefer_name);
     int labelScript();
+    void compileScript();
 
     LabelInfo lookupLabel(const pstring& label);
     LabelInfo lookupLabelNext(const pstring& label);
+    bool hasLabel(const pstring& label) const
+        { return findLabelIndex(label) >= 0; }
+
+    // The names a script uses and defines, found without running it,
+    // so that it can be checked in one pass.  Only what can be told
+    // from the text alone is found: command names, label references,
+    // and aliases where they can only be aliases.
+    struct ScriptRef {
+        enum Kind { Command, Label, Alias, DefineAlias, DefineSub };
+        Kind kind;
+        int offset;
+        pstring name; // lowercased, without its '*', '%' or '$'
+    };
+    void scanScript(std::vector<ScriptRef>& refs);
     void errorAndExit(pstring str);
     void errorWarning(pstring str);
 
     void loadArrayVariable(FILE* fp);
 
     void addNumAlias(const pstring& str, int val)
-	{ checkalias(str); num_aliases[str] = val; }
+	{ checkalias(str); num_aliases[str] = val; ++alias_generation; }
     void addStrAlias(const pstring& str, const pstring& val)
 	{ checkalias(str); str_aliases[str] = val; }
 
@@ -322,13 +345,16 @@ private:
     };
 
     LabelInfo::iterator findLabel(pstring label);
+    LabelInfo::iterator findLabelByAddress(const char* address);
+    LabelInfo::iterator findLabelByLine(int line);
+    int lineOf(const char* address) const;
 
     const char* checkComma(const char* buf);
     pstring parseStr(const char** buf);
     int  parseIntExpression(const char** buf);
     void readNextOp(const char** buf, int* op, int* num);
     int  calcArithmetic(int num1, int op, int num2);
-    typedef std::pair<int, h_index_t> array_ref;
+    typedef std::pair<int, array_index_t> array_ref;
     array_ref parseArray(const char** buf);
     
     /* ---------------------------------------- */
@@ -339,7 +365,12 @@ private:
         VariableData vd;
         ExtendedVariableData(int n): no(n) {}
     };
-    std::vector<ExtendedVariableData> extended_variable_data;
+    // A deque, so that references to variables stay valid as more
+    // are added; found through a hash table of indices.
+    std::deque<ExtendedVariableData> extended_variable_data;
+    std::vector<int> extended_variable_slots;
+    static unsigned int hashVariable(int no)
+        { unsigned int h = no * 2654435761u; return h ^ (h >> 16); }
 
     typedef dictionary<pstring, int>::t    numalias_t;
     typedef dictionary<pstring, pstring>::t stralias_t;
@@ -347,20 +378,96 @@ private:
     numalias_t num_aliases;
     stralias_t str_aliases;
 
+    // Pre-tokenised script, and what its names resolve to.  Aliases
+    // may be redefined, so each resolution is stamped with the alias
+    // generation it was made in.
+    ScriptCode code;
+    const ScriptCode::Token* token(const char* pos, int type) const {
+        if (pos < script_buffer || pos >= script_buffer + script_buffer_length)
+            return NULL;
+        return code.find(pos - script_buffer, type);
+    }
+    bool numAlias(int name, int& val);
+    int alias_generation;
+    std::vector<int> num_alias_stamp, num_alias_value;
+    std::vector<int> label_by_name; // label_info index, or -1
+    int label_hint; // label named by the last label reference parsed
+
     DirPaths *archive_path;
     int   script_buffer_length;
     char* raw_script_buffer;
     char* script_buffer;
-    char* tmp_script_buf;
+    int   script_buffer_capacity;
 
     pstring string_buffer; // updated only by readToken (is this true?)
+    int current_command;
 
     LabelInfo::vec label_info;
-    LabelInfo::dic label_names;
+    std::vector<int> label_table; // label_info indices, hashed by name
+    std::vector<int> line_starts; // offset of each line in script_buffer
     
     bool  skip_enabled;
     bool  kidokuskip_flag;
-    char* kidoku_buffer;
+
+    // Read-text history.  Text statements are numbered when the script
+    // is labelled.  readToken() may split a statement's line into several
+    // text tokens, at click waits and clickstr breaks, so what has been
+    // read is each token, known by its statement and where in the line
+    // it starts.  Where tokens start depends on textgosub and clickstr
+    // as the script runs, so each statement is given a bit in kidoku_read
+    // for every place in its line one could start.  On disk a statement
+    // is known by a key made from its label, its text and how often that
+    // text has occurred before in the label, so edits elsewhere in the
+    // script don't lose it; tokens are appended as they are read, rather
+    // than the whole history being rewritten.
+    struct KidokuStatement {
+        int offset; // where the statement starts
+        int end;    // where its line ends
+        int first;  // its first bit in kidoku_read
+        unsigned int key[2];
+    };
+    std::vector<KidokuStatement> kidoku_statements; // in script order
+    std::vector<bool> kidoku_read;
+    std::vector<int> kidoku_unsaved; // bits set since kidoku.dat was written
+    std::vector<unsigned int> kidoku_foreign; // entries not in this script
+    bool kidoku_loaded;
+    bool kidoku_rewrite; // kidoku.dat must be written out in full
+    typedef std::map<std::pair<unsigned int, unsigned int>, int> textcount_t;
+    static void keyTextStatement(KidokuStatement& st, const char* script,
+                                 const pstring* label,
+                                 textcount_t& occurrences);
+    int findTextStatement(const char* address) const;
+    int findKidokuStatement(int bit) const;
+
+    // Large scripts are labelled in pieces, on as many threads, each
+    // piece starting at the beginning of a line.  Lines, labels and
+    // text statements are counted from the start of the piece, and
+    // text before its first label can only be keyed once the label it
+    // belongs to is known.
+    struct LabelChunk {
+        const char* script;
+        const char* begin;
+        const char* end;
+        int lines;
+        int lines_before_label;
+        LabelInfo::vec labels;
+        std::vector<KidokuStatement> pending; // before the first label
+        std::vector<KidokuStatement> statements;
+        textcount_t occurrences; // under the last label
+        std::vector<int> line_starts;
+    };
+    static int labelChunk(void* chunk);
+    void indexLabels();
+    void splitScript(std::vector<const char*>& bounds) const;
+    int findLabelIndex(pstring label) const;
+
+    struct ScanChunk {
+        const char* script;
+        const char* begin;
+        const char* end;
+        std::vector<ScriptRef> refs;
+    };
+    static int scanChunk(void* chunk);
 
     bool  text_flag; // true if the current token is text
     int   end_status;
@@ -211,6 +211,7 @@ ScriptParser::~ScriptParser()
 void ScriptParser::reset()
 {
     user_func_lut.clear();
+    unresolveCommands();
 
     // reset misc variables
     nsa_path.trunc(0);
@@ -332,7 +333,13 @@ int ScriptParser::open(const char* preferred_script)
 
     script_h.game_identifier = cmdline_game_id;
 
+    Uint64 start = SDL_GetPerformanceCounter();
     if (script_h.readScript(&archive_path, preferred_script)) return -1;
+    if (debug_level > 0)
+        printf("Loaded and labelled %d bytes of script in %.1f ms\n",
+               script_h.getScriptBufferLength(),
+               (SDL_GetPerformanceCounter() - start) * 1000.0 /
+               SDL_GetPerformanceFrequency());
 
     screen_ratio1 = 1;
     screen_ratio2 = 1;
@@ -490,16 +497,71 @@ rgb_t ScriptParser::readColour(const char* buf)
 }
 
 
+ScriptParser::Command& ScriptParser::command(int id)
+{
+    // The table is sized once, so that names in it stay put while
+    // the commands they were passed to run.
+    if (commands.empty()) commands.resize(script_h.getNames());
+
+    Command& c = commands[id];
+    if (c.kind == Command::Unresolved) {
+        const pstring& name = script_h.getName(id);
+        c.orig = name[0] == '_';
+        c.name = c.orig ? name.midstr(1, name.length() - 1) : name;
+        if (!c.orig && user_func_lut.find(name) != user_func_lut.end())
+            c.kind = Command::User;
+        else if ((c.fun = func_lut.get(c.name)) != 0)
+            c.kind = Command::Parser;
+        else
+            c.kind = Command::Other;
+    }
+    return c;
+}
+
+
+bool ScriptParser::isParserCommand(const pstring& name)
+{
+    return func_lut.get(name) != 0;
+}
+
+
+void ScriptParser::unresolveCommands()
+{
+    for (std::vector<Command>::iterator c = commands.begin();
+         c != commands.end(); ++c)
+        c->kind = Command::Unresolved;
+}
+
+
 int ScriptParser::parseLine()
 {
-    pstring cmd = script_h.getStrBuf();
     if (debug_level > 1) {
-        printf("ScriptParser::Parseline %s\n", (const char*) cmd);
+        printf("ScriptParser::Parseline %s\n",
+               (const char*) script_h.getStrBuf());
         fflush(stdout);
     }
 
     if (script_h.isText()) return RET_NOMATCH;
 
+    int id = script_h.getCommand();
+    if (id >= 0) {
+        Command& c = command(id);
+        if (c.kind == Command::User) {
+            gosubReal(c.name, script_h.getNext());
+            return RET_CONTINUE;
+        }
+        if (c.kind != Command::Parser) return RET_NOMATCH;
+        if (c.orig && (debug_level > 0)) {
+            printf("** executing builtin command '%s' **\n",
+                   (const char*) c.name);
+            fflush(stdout);
+        }
+        return (this->*c.fun)(c.name);
+    }
+
+    // Commands that were not in the script when it was loaded.
+    pstring cmd = script_h.getStrBuf();
+
     if (cmd[0] == ';' || cmd[0] == '*' || cmd[0] == ':' || cmd[0] == 0x0a)
 	return RET_CONTINUE;
 
@@ -200,6 +200,23 @@ public:
 protected:
     set<pstring>::t user_func_lut;
 
+    // Commands, user-defined or builtin, indexed by the name interned
+    // for them when the script was tokenised.  Each is looked up by
+    // name once, the first time it runs, and again only when a defsub
+    // might have changed what it means.
+    typedef int (ScriptParser::*CommandFun)(const pstring&);
+    struct Command {
+        enum { Unresolved, User, Parser, Other, Label, Missing } kind;
+        bool orig;      // _command: always the builtin
+        pstring name;   // without any leading _
+        CommandFun fun; // Label functions are cast from PonscripterLabel
+        Command() : kind(Unresolved), orig(false), fun(0) {}
+    };
+    std::vector<Command> commands;
+    Command& command(int id);
+    void unresolveCommands();
+    static bool isParserCommand(const pstring& name);
+
     struct NestInfo {
     typedef std::vector<NestInfo> vector;
     typedef vector::iterator iterator;
@@ -1085,6 +1085,7 @@ int ScriptParser::defvoicevolCommand(const pstring& cmd)
 int ScriptParser::defsubCommand(const pstring& cmd)
 {
     user_func_lut.insert(script_h.readBareword());
+    unresolveCommands();
     return RET_CONTINUE;
 }
 
@@ -0,0 +1,121 @@
+/* -*- C++ -*-
+ *
+ *  WorkerPool.cpp - Threads for splitting image work into strips
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+#include "WorkerPool.h"
+#include <SDL.h>
+#include <vector>
+
+enum { MAX_THREADS = 8 };
+
+static SDL_mutex* lock = NULL;
+static SDL_cond* work_ready = NULL;
+static SDL_cond* work_done = NULL;
+static int threads = 0; // including the main thread; 0 until started
+
+// The job in hand, guarded by lock.  generation changes with each
+// job, so that a worker never picks up the same one twice.
+static WorkerPool::Job job;
+static void* job_data;
+static int job_begin, job_end, strips, next_strip, strips_done;
+static unsigned int generation = 0;
+
+// Does strips of the current job until there are none left.  Called
+// with the lock held, and returns with it held.
+static void work()
+{
+    while (next_strip < strips) {
+        const int s = next_strip++;
+        const int begin = job_begin + (job_end - job_begin) * s / strips;
+        const int end = job_begin + (job_end - job_begin) * (s + 1) / strips;
+        WorkerPool::Job j = job;
+        void* data = job_data;
+        SDL_UnlockMutex(lock);
+        j(data, begin, end);
+        SDL_LockMutex(lock);
+        if (++strips_done == strips) SDL_CondSignal(work_done);
+    }
+}
+
+
+static int worker(void*)
+{
+    SDL_LockMutex(lock);
+    unsigned int seen = generation;
+    while (1) {
+        while (generation == seen) SDL_CondWait(work_ready, lock);
+        seen = generation;
+        work();
+    }
+    return 0;
+}
+
+
+static void start()
+{
+    threads = SDL_GetCPUCount();
+    if (threads > MAX_THREADS) threads = MAX_THREADS;
+    if (threads <= 1) {
+        threads = 1;
+        return;
+    }
+
+    lock = SDL_CreateMutex();
+    work_ready = SDL_CreateCond();
+    work_done = SDL_CreateCond();
+    if (!lock || !work_ready || !work_done) {
+        threads = 1;
+        return;
+    }
+    for (int i = 1; i < threads; ++i) {
+        SDL_Thread* t = SDL_CreateThread(worker, "worker", NULL);
+        if (!t) {
+            threads = i;
+            break;
+        }
+        SDL_DetachThread(t);
+    }
+}
+
+
+void WorkerPool::run(Job j, void* data, int begin, int end, int min_rows)
+{
+    if (!threads) start();
+
+    int n = threads;
+    if (min_rows < 1) min_rows = 1;
+    if (n > (end - begin) / min_rows) n = (end - begin) / min_rows;
+    if (n <= 1) {
+        if (end > begin) j(data, begin, end);
+        return;
+    }
+
+    SDL_LockMutex(lock);
+    job = j;
+    job_data = data;
+    job_begin = begin;
+    job_end = end;
+    strips = n;
+    next_strip = strips_done = 0;
+    ++generation;
+    SDL_CondBroadcast(work_ready);
+    work();
+    while (strips_done < strips) SDL_CondWait(work_done, lock);
+    SDL_UnlockMutex(lock);
+}
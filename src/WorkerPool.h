@@ -0,0 +1,42 @@
+/* -*- C++ -*-
+ *
+ *  WorkerPool.h - Threads for splitting image work into strips
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 2 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ */
+
+#ifndef __WORKER_POOL_H__
+#define __WORKER_POOL_H__
+
+// Effects redraw the whole screen every frame, and each row can be
+// done independently of the others, so the rows are shared out among
+// a few threads that wait between frames rather than being created
+// for each one.  Every row is computed exactly as it would be on one
+// thread, so results don't depend on how many there are.
+//
+// Jobs are only started from the main thread.
+class WorkerPool {
+public:
+    typedef void (*Job)(void* data, int begin, int end);
+
+    // Runs job on the rows [begin, end), split into one strip per
+    // thread, and returns once every strip is done.  Fewer threads
+    // are used where there would be under min_rows rows each.
+    static void run(Job job, void* data, int begin, int end,
+                    int min_rows = 32);
+};
+
+#endif // __WORKER_POOL_H__
@@ -64,6 +64,31 @@ struct set {
 };
 typedef std::vector<int> h_index_t;
 
+// Array subscripts.  Arrays rarely have more than a few dimensions, so
+// that many subscripts are kept inline and only deeper ones go to the
+// heap; indexing an array element then allocates nothing.
+class array_index_t {
+    enum { inline_size = 4 };
+    int n;
+    int inl[inline_size];
+    std::vector<int> more;
+public:
+    array_index_t() : n(0), inl() {}
+
+    int size() const { return n; }
+    bool empty() const { return n == 0; }
+    void clear() { n = 0; more.clear(); }
+    void push_back(int v) {
+        if (n < inline_size) inl[n] = v; else more.push_back(v);
+        ++n;
+    }
+    int& operator[](int i)
+        { return i < inline_size ? inl[i] : more[i - inline_size]; }
+    int operator[](int i) const
+        { return i < inline_size ? inl[i] : more[i - inline_size]; }
+    int& back() { return (*this)[n - 1]; }
+};
+
 struct __attribute__((__packed__))
 rgb_t {
     unsigned char r, g, b;
@@ -117,7 +142,7 @@ void print_escaped(const pstring& what, FILE* where = stdout, bool newline = 0)
 }
 
 // Random number generation
-void init_rnd();
+void init_rnd(long s = 0); // 0 seeds from the clock
 int get_rnd(int lower, int upper);
 
 #endif
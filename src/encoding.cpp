@@ -32,83 +32,123 @@ struct ligature {
     ligature() : codepoint(0), seqlen(0) {}
 };
 
-// A "tree" mapping character sequences to particular ligatures
+// Ligature sequences compiled into a flat DFA.  Every byte that occurs
+// in some sequence is given an input class; all other bytes map to
+// class 0, which always leads to the dead state.  The table is rebuilt
+// lazily on the first lookup after the set of ligatures changes, so a
+// run of AddLigature() calls only pays for one compilation.
 class ligatures {
-    typedef std::map<char, ligatures*> ligmap;
-    typedef ligmap::iterator ligmap_iter;
-    typedef std::pair<char, ligatures*> lignode;
-    typedef std::pair<ligmap_iter, bool> ligmap_insertion;
-    ligature val;
-    ligmap children;
-    
+    typedef std::map<pstring, wchar> source_t;
+    typedef source_t::const_iterator source_iter;
+    source_t source;
+    bool dirty;
+
+    enum { DEAD = 0, ROOT = 1 };
+    unsigned char byte_class[256];
+    int num_classes;
+    std::vector<int> next;       // state * num_classes + class -> state
+    std::vector<ligature> val;   // ligature ending at each state, if any
+    std::vector<int> fallback;   // nearest accepting proper prefix state
+
+    void compile();
+
 public:
     void clear();
-    ligature* find(const char* seq, const Fontinfo* face);
-    void add(const char* seq, wchar value, int depth = 0);
-    void del(const char* seq);
-    
-    ~ligatures() { clear(); }
+    const ligature* find(const char* seq, const Fontinfo* face);
+    void add(const pstring& seq, wchar value);
+    void del(const pstring& seq);
+
+    ligatures() : dirty(true), num_classes(1) {}
 };
 static ligatures ligs;
 
 void ligatures::clear()
 {
-    for (ligmap_iter it=children.begin() ; it != children.end(); ) {
-        if (it->second) delete it->second;
-        it->second = 0;
-        children.erase(it++);
-    }
+    source.clear();
+    dirty = true;
 }
 
-ligature* ligatures::find(const char* seq, const Fontinfo* face)
+void ligatures::add(const pstring& seq, wchar value)
 {
-    ligature* v = 0;
-    ligmap_iter e = children.find(*seq);
-    if (e != children.end())
-        v = e->second->find(seq + 1, face);
-    if (!v && val.codepoint &&
-        (!face || face->font()->has_char(val.codepoint)))
-        v = &val;
-    return v;
+    // An empty sequence would match everywhere without consuming input.
+    if (seq.length() == 0) return;
+    source[seq] = value;
+    dirty = true;
 }
 
-void ligatures::add(const char* seq, wchar value, int depth)
+void ligatures::del(const pstring& seq)
 {
-    if (*seq) {
-        // add/retrieve the branch to the node for *seq char
-        ligmap_insertion p = children.insert(lignode(*seq, 0));
-        if (p.second) {
-            if (p.first->second) delete p.first->second;
-            p.first->second = new ligatures;
+    if (source.erase(seq)) dirty = true;
+}
+
+void ligatures::compile()
+{
+    memset(byte_class, 0, sizeof(byte_class));
+    num_classes = 1;
+    for (source_iter it = source.begin(); it != source.end(); ++it) {
+        const unsigned char* c = (const unsigned char*) (const char*) it->first;
+        for (int i = 0; i < it->first.length(); ++i)
+            if (!byte_class[c[i]]) byte_class[c[i]] = num_classes++;
+    }
+
+    // States 0 (dead) and 1 (root) always exist.
+    next.assign(2 * num_classes, DEAD);
+    val.assign(2, ligature());
+    fallback.assign(2, DEAD);
+
+    for (source_iter it = source.begin(); it != source.end(); ++it) {
+        const unsigned char* c = (const unsigned char*) (const char*) it->first;
+        const int len = it->first.length();
+        int state = ROOT;
+        for (int i = 0; i < len; ++i) {
+            // Growing the table invalidates references into it.
+            const int edge = state * num_classes + byte_class[c[i]];
+            if (next[edge] == DEAD) {
+                next[edge] = val.size();
+                next.resize(next.size() + num_classes, DEAD);
+                val.push_back(ligature());
+                fallback.push_back(DEAD);
+            }
+            state = next[edge];
         }
-        // process the *seq node (p.first->second), adding more of the sequence
-        p.first->second->add(seq + 1, value, depth + 1);
+        val[state].codepoint = it->second;
+        val[state].seqlen = len;
     }
-    else {
-        //end of the sequence - put the ligature code into the contents
-        val.codepoint = value;
-        val.seqlen = depth;
+
+    // States are created while walking down from the root, so every
+    // parent is numbered before its children: one forward pass
+    // propagates the nearest accepting ancestor down the tree.
+    for (int state = ROOT; state < (int) val.size(); ++state) {
+        const int inherit = val[state].codepoint ? state : fallback[state];
+        for (int k = 1; k < num_classes; ++k) {
+            const int t = next[state * num_classes + k];
+            if (t != DEAD) fallback[t] = inherit;
+        }
     }
+
+    dirty = false;
 }
 
-void ligatures::del(const char* seq)
+// Returns the longest ligature matching the start of seq whose
+// codepoint exists in the given face (any face if NULL).
+const ligature* ligatures::find(const char* seq, const Fontinfo* face)
 {
-    if (*seq) {
-        // retrieve the branch to the node for *seq char
-        ligmap_iter e = children.find(*seq);
-        if (e != children.end()) {
-            // got the branch, now process the *seq node (e->second),
-            // deleting further along the sequence
-            e->second->del(seq + 1);
-            // if *seq node is now empty (no branches or content),
-            // remove it entirely
-            if (!e->second->val.codepoint && e->second->children.empty())
-                children.erase(e);
-        }
+    if (dirty) compile();
+
+    const unsigned char* c = (const unsigned char*) seq;
+    int state = ROOT, match = DEAD;
+    while (*c) {
+        state = next[state * num_classes + byte_class[*c++]];
+        if (state == DEAD) break;
+        if (val[state].codepoint) match = state;
     }
-    else {
-        val.codepoint = 0;
+
+    if (match != DEAD && face) {
+        Font* font = face->font();
+        while (match != DEAD && !font->has_char(val[match].codepoint))
+            match = fallback[match];
     }
+    return match != DEAD ? &val[match] : 0;
 }
 
 
@@ -33,9 +33,8 @@ pstring Expression::debug_string() const
 	    break;
 	case Array:
 	    rv.format("?%d", intval_);
-	    for (h_index_t::const_iterator it = index_.begin();
-		 it != index_.end(); ++it)
-		rv.formata("[%d]", *it);
+	    for (int i = 0; i < index_.size(); ++i)
+		rv.formata("[%d]", index_[i]);
 	    break;
 	default:
 	    rv = "[invalid type]";
@@ -47,13 +46,13 @@ pstring Expression::debug_string() const
 	    rv.format("%d", intval_);
 	    break;
 	case String:
-	    rv.format("\"%s\"", (const char*) strval_);
+	    rv.format("\"%s\"", (const char*) str());
 	    break;
 	case Label:
-	    rv.format("*%s", (const char*) strval_);
+	    rv.format("*%s", (const char*) str());
 	    break;
 	case Bareword:
-	    rv = strval_;
+	    rv = str();
 	    break;
 	default:
 	    rv = "[invalid type]";
@@ -65,7 +64,7 @@ pstring Expression::debug_string() const
 bool Expression::is_bareword(pstring what) const
 {
     if (type_ != Bareword) return false;
-    return what.caselessEqual(strval_);
+    return what.caselessEqual(str());
 }
 
 void Expression::require(type_t t) const
@@ -98,10 +97,16 @@ void Expression::require_numeric() const
 	die("expected number, found " + typestr(type_, var_));
 }
 
+const pstring& Expression::str() const
+{
+    static const pstring empty;
+    return strval_ ? *strval_ : empty;
+}
+
 pstring Expression::as_string() const
 {
     if (is_textual() && is_constant())
-	return strval_;
+	return str();
     else if (is_textual())
 	return h.getVariableData(intval_).str;
     else if (is_numeric()) {
@@ -146,7 +151,7 @@ void Expression::mutate(int newval, int offset, bool as_array)
     }
     else if (type_ == Array) {
 	require_variable();
-	h_index_t i = index_;
+	array_index_t i = index_;
 	if (offset != MAX_INT) {
 	    if (as_array)
 		i.push_back(offset);
@@ -178,21 +183,27 @@ void Expression::append(wchar newval)
 }
 
 Expression::Expression(ScriptHandler& sh)
-    : h(sh), type_(Int), var_(false), strval_(""), intval_(0)
+    : h(sh), type_(Int), var_(false), strval_(0), intval_(0)
 {}
 
 Expression::Expression(ScriptHandler& sh, type_t t, bool is_v, int val)
-    : h(sh), type_(t), var_(is_v), strval_(""), intval_(val)
+    : h(sh), type_(t), var_(is_v), strval_(0), intval_(val)
 {}
 
 Expression::Expression(ScriptHandler& sh, type_t t, bool is_v, int val,
-                       const h_index_t& idx)
-    : h(sh), type_(t), var_(is_v), index_(idx), strval_(""), intval_(val)
+                       const array_index_t& idx)
+    : h(sh), type_(t), var_(is_v), index_(idx), strval_(0), intval_(val)
 {}
 
 Expression::Expression(ScriptHandler& sh, type_t t, bool is_v,
                        const pstring& val)
-    : h(sh), type_(t), var_(is_v), strval_(val), intval_(0)
+    : h(sh), type_(t), var_(is_v), strval_(new pstring(val)), intval_(0)
+{}
+
+Expression::Expression(const Expression& src)
+    : h(src.h), type_(src.type_), var_(src.var_), index_(src.index_),
+      strval_(src.strval_ ? new pstring(*src.strval_) : 0),
+      intval_(src.intval_)
 {}
 
 Expression& Expression::operator=(const Expression& src)
@@ -203,7 +214,12 @@ Expression& Expression::operator=(const Expression& src)
     type_ = src.type_;
     var_ = src.var_;
     index_ = src.index_;
-    strval_ = src.strval_;
+    if (src.strval_ && strval_)
+        *strval_ = *src.strval_;
+    else {
+        delete strval_;
+        strval_ = src.strval_ ? new pstring(*src.strval_) : 0;
+    }
     intval_ = src.intval_;
     return *this;
 }
@@ -52,17 +52,22 @@ public:
     Expression(ScriptHandler& sh);
     Expression(ScriptHandler& sh, type_t t, bool is_v, int val);
     Expression(ScriptHandler& sh, type_t t, bool is_v, int val,
-	       const h_index_t& idx);
+	       const array_index_t& idx);
     Expression(ScriptHandler& sh, type_t t, bool is_v, const pstring& val);
 
+    Expression(const Expression& src);
     Expression& operator=(const Expression& src);    
+    ~Expression() { delete strval_; }
 private:
     void die(const char* why) const;
+    const pstring& str() const;
     ScriptHandler& h;
     type_t type_;
     bool var_;
-    h_index_t index_;
-    pstring strval_;
+    array_index_t index_;
+    // Only constant text has a string, so that numbers, which are most
+    // expressions, can be made and copied without allocating.
+    pstring* strval_;
     int intval_;
 };
 
@@ -29,17 +29,109 @@
 
 #include "font.h"
 
+#ifndef WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 
 FT_Library freetype;
 
+// Faces may be opened on a background thread (see Fontinfo.cpp), and
+// FreeType requires face creation and destruction within a library to
+// be serialised.  This also guards font_files below.
+static SDL_mutex* face_lock = NULL;
+
 void FontInitialise()
 {
     FT_Init_FreeType(&freetype);
+    face_lock = SDL_CreateMutex();
 }
 
 void FontFinished()
 {
     FT_Done_FreeType(freetype);
+    SDL_DestroyMutex(face_lock);
+    face_lock = NULL;
+}
+
+
+// Font files are mapped into memory rather than copied onto the heap,
+// and a file used by several styles is only mapped once.
+struct FontFile {
+    pstring name;
+    Uint8* data;
+    size_t len;
+    bool mapped;
+    int refcount;
+};
+
+static std::map<pstring, FontFile*> font_files;
+
+// Call with face_lock held.
+static FontFile* open_font_file(const char* filename)
+{
+    std::map<pstring, FontFile*>::iterator it = font_files.find(filename);
+    if (it != font_files.end()) {
+        ++it->second->refcount;
+        return it->second;
+    }
+
+    FontFile* f = new FontFile;
+    f->name = filename;
+    f->data = NULL;
+    f->len = 0;
+    f->mapped = false;
+    f->refcount = 1;
+
+#ifndef WIN32
+    int fd = open(filename, O_RDONLY);
+    struct stat st;
+    if (fd >= 0 && fstat(fd, &st) == 0 && st.st_size > 0) {
+        void* p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+            madvise(p, st.st_size, MADV_WILLNEED);
+            f->data = (Uint8*) p;
+            f->len = st.st_size;
+            f->mapped = true;
+        }
+    }
+    if (fd >= 0) close(fd);
+#endif
+
+    if (!f->mapped) {
+        FILE* fp = fopen(filename, "rb");
+        if (!fp) {
+            fprintf(stderr, "ERROR: This should never happen.\n");
+            exit(1);
+        }
+        fseek(fp, 0, SEEK_END);
+        f->len = ftell(fp);
+        fseek(fp, 0, SEEK_SET);
+        f->data = new Uint8[f->len];
+        fread(f->data, 1, f->len, fp);
+        fclose(fp);
+    }
+
+    font_files[f->name] = f;
+    return f;
+}
+
+// Call with face_lock held.
+static void close_font_file(FontFile* f)
+{
+    if (--f->refcount) return;
+
+    font_files.erase(f->name);
+#ifndef WIN32
+    if (f->mapped)
+        munmap(f->data, f->len);
+    else
+#endif
+        delete[] f->data;
+    delete f;
 }
 
 HintingMode hinting = NoHinting;
@@ -77,6 +169,24 @@ kerning_mode()
 #define FT_FLOOR(X) (((X) & - 64) / 64)
 #define FT_CEIL(X) ((((X) +63) & - 64) / 64)
 
+// Rendered glyphs are kept in a small direct-mapped cache per face, so
+// repeated characters don't go back through FreeType.
+struct GlyphCacheEntry {
+    bool used;
+    Uint16 ch;
+    int size, frac;
+    FT_Int32 load;
+    FT_Render_Mode render;
+    SDL_Color fg, bg;
+    Glyph glyph;
+    bool has_shadow;
+    GlyphShadow shadow;
+
+    GlyphCacheEntry() : used(false), has_shadow(false) {}
+};
+
+const int GLYPH_CACHE_SIZE = 512;
+
 struct FontInternals {
     FT_Open_Args args, met;
     FT_Face face;
@@ -84,12 +194,24 @@ struct FontInternals {
 
     int currsize;
     bool del_data;
+    FontFile *file, *metfile;
+
+    // has_char() results, filled in lazily: a bit is set in char_known
+    // once the codepoint has been looked up, and in char_present if the
+    // face maps it to a glyph.
+    std::vector<Uint32> char_known, char_present;
+
+    GlyphCacheEntry glyph_cache[GLYPH_CACHE_SIZE];
 
     FontInternals(const Uint8* data, size_t len, const Uint8* mdat,
 		  size_t mlen, bool own);
 
     ~FontInternals() {
+        SDL_LockMutex(face_lock);
         FT_Done_Face(face);
+        if (file) close_font_file(file);
+        if (metfile) close_font_file(metfile);
+        SDL_UnlockMutex(face_lock);
         if (del_data) {
             delete[] (const Uint8*) args.memory_base;
             if (met.memory_base) delete[] (const Uint8*) met.memory_base;
@@ -102,11 +224,18 @@ struct FontInternals {
 			    load_mode());
         return face->glyph;
     }
+
+    GlyphCacheEntry& cache_slot(Uint16 ch, int frac)
+    {
+        return glyph_cache[(ch * 31 + currsize * 7 + frac)
+                           & (GLYPH_CACHE_SIZE - 1)];
+    }
 };
 
 FontInternals::FontInternals(const Uint8* data, size_t len, const Uint8* mdat,
                              size_t mlen, bool own)
-    : currsize(0), del_data(own)
+    : currsize(0), del_data(own), file(NULL), metfile(NULL),
+      char_known(0x10000 / 32), char_present(0x10000 / 32)
 {
     args.flags = FT_OPEN_MEMORY;
     args.memory_base = (const FT_Byte*) data;
@@ -114,6 +243,7 @@ FontInternals::FontInternals(const Uint8* data, size_t len, const Uint8* mdat,
     met.flags = FT_OPEN_MEMORY;
     met.memory_base = mdat;
     met.memory_size = mlen;
+    SDL_LockMutex(face_lock);
     FT_Error err = FT_Open_Face(freetype, &args, 0, &face);
     if (err) {
 	fprintf(stderr, "ERROR: Failed to open face.\n");
@@ -121,45 +251,22 @@ FontInternals::FontInternals(const Uint8* data, size_t len, const Uint8* mdat,
     }
 
     if (mdat) FT_Attach_Stream(face, &met);
+    SDL_UnlockMutex(face_lock);
 }
 
 
 Font::Font(const char* filename, const char* metrics)
 {
-    Uint8* data, * mdat;
-    size_t len, mlen;
-    FILE*  fp = fopen(filename, "rb");
-    if (!fp) {
-	fprintf(stderr, "ERROR: This should never happen.\n");
-	exit(1);
-    }
-
-    fseek(fp, 0, SEEK_END);
-    len = ftell(fp);
-    fseek(fp, 0, SEEK_SET);
-    data = new Uint8[len];
-    fread(data, 1, len, fp);
-    fclose(fp);
-    if (metrics) {
-        fp = fopen(metrics, "rb");
-        if (!fp) {
-	    fprintf(stderr, "ERROR: This should never happen.\n");
-	    exit(1);
-	}
-
-        fseek(fp, 0, SEEK_END);
-        mlen = ftell(fp);
-        fseek(fp, 0, SEEK_SET);
-        mdat = new Uint8[mlen];
-        fread(mdat, 1, mlen, fp);
-        fclose(fp);
-    }
-    else {
-        mdat = NULL;
-        mlen = 0;
-    }
-
-    priv = new FontInternals(data, len, mdat, mlen, true);
+    SDL_LockMutex(face_lock);
+    FontFile* file = open_font_file(filename);
+    FontFile* metfile = metrics ? open_font_file(metrics) : NULL;
+    SDL_UnlockMutex(face_lock);
+
+    priv = new FontInternals(file->data, file->len,
+                             metfile ? metfile->data : NULL,
+                             metfile ? metfile->len : 0, false);
+    priv->file = file;
+    priv->metfile = metfile;
 }
 
 
@@ -256,12 +363,49 @@ void Font::set_size(int val)
 }
 
 
+static void
+set_palette(SDL_Surface* bitmap, SDL_Color fg, SDL_Color bg)
+{
+    // Fill palette with 256 shades interpolating between foreground
+    // and background colours.
+    SDL_Palette* pal = bitmap->format->palette;
+    int dr = fg.r - bg.r;
+    int dg = fg.g - bg.g;
+    int db = fg.b - bg.b;
+    for (int i = 0; i < 256; ++i) {
+        pal->colors[i].r = bg.r + i * dr / 255;
+        pal->colors[i].g = bg.g + i * dg / 255;
+        pal->colors[i].b = bg.b + i * db / 255;
+    }
+}
+
+
+static inline bool
+same_colour(SDL_Color a, SDL_Color b)
+{
+    return a.r == b.r && a.g == b.g && a.b == b.b;
+}
+
+
 Glyph Font::render_glyph(Uint16 ch, SDL_Color fg, SDL_Color bg, float x_fractional_part)
 {
     Glyph rv;
     FT_Vector v;
     v.x = subpixel ? FT_Pos(x_fractional_part * 64.0) : 0;
     v.y = 0;
+
+    GlyphCacheEntry& slot = priv->cache_slot(ch, v.x);
+    if (slot.used && slot.ch == ch && slot.size == priv->currsize &&
+        slot.frac == v.x && slot.load == load_mode() &&
+        slot.render == render_mode()) {
+        if (!same_colour(slot.fg, fg) || !same_colour(slot.bg, bg)) {
+            set_palette(slot.glyph.bitmap, fg, bg);
+            slot.fg = fg;
+            slot.bg = bg;
+        }
+        return slot.glyph;
+    }
+
     FT_Set_Transform(priv->face, 0, &v);
 
     FT_GlyphSlot glyph = priv->load_glyph(ch);
@@ -277,17 +421,7 @@ Glyph Font::render_glyph(Uint16 ch, SDL_Color fg, SDL_Color bg, float x_fraction
     rv.left = glyph->bitmap_left;
     rv.top = glyph->bitmap_top;
 
-    // Fill palette with 256 shades interpolating between foreground
-    // and background colours.
-    SDL_Palette* pal = rv.bitmap->format->palette;
-    int dr = fg.r - bg.r;
-    int dg = fg.g - bg.g;
-    int db = fg.b - bg.b;
-    for (int i = 0; i < 256; ++i) {
-        pal->colors[i].r = bg.r + i * dr / 255;
-        pal->colors[i].g = bg.g + i * dg / 255;
-        pal->colors[i].b = bg.b + i * db / 255;
-    }
+    set_palette(rv.bitmap, fg, bg);
 
     // Copy the character from the pixmap
     Uint8* src = (Uint8*) glyph->bitmap.buffer;
@@ -301,12 +435,70 @@ Glyph Font::render_glyph(Uint16 ch, SDL_Color fg, SDL_Color bg, float x_fraction
 
     SDL_UnlockSurface(rv.bitmap);
 
+    slot.used = true;
+    slot.ch = ch;
+    slot.size = priv->currsize;
+    slot.frac = v.x;
+    slot.load = load_mode();
+    slot.render = render_mode();
+    slot.fg = fg;
+    slot.bg = bg;
+    slot.glyph = rv;
+    slot.has_shadow = false;
+
     return rv;
 }
 
 
+const GlyphShadow&
+Font::render_shadow(Uint16 ch, float x_fractional_part, int x, int y)
+{
+    static const SDL_Color fg = { 0xff, 0xff, 0xff, 0xff },
+                           bg = { 0, 0, 0, 0 };
+    static GlyphShadow empty;
+
+    Glyph g = render_glyph(ch, fg, bg, x_fractional_part);
+    if (!g.bitmap) return empty;
+
+    // render_glyph() has just made this slot hold g.
+    const FT_Pos frac = subpixel ? FT_Pos(x_fractional_part * 64.0) : 0;
+    GlyphCacheEntry& slot = priv->cache_slot(ch, frac);
+    GlyphShadow& s = slot.shadow;
+    if (slot.has_shadow && s.x == x && s.y == y) return s;
+
+    const SDL_Surface* b = g.bitmap;
+    s.x = x;
+    s.y = y;
+    s.left = x < 0 ? x : 0;
+    s.top  = y < 0 ? y : 0;
+    s.w = b->w + abs(x);
+    s.h = b->h + abs(y);
+    s.coverage.assign(2 * s.w * s.h, 0);
+
+    for (int row = 0; row < b->h; ++row) {
+        const Uint8* src = (const Uint8*) b->pixels + b->pitch * row;
+        Uint8* fill = &s.coverage[2 * ((row - s.top) * s.w - s.left) + 1];
+        Uint8* shade = &s.coverage[2 * ((row + y - s.top) * s.w + x - s.left)];
+        for (int col = 0; col < b->w; ++col) {
+            fill[2 * col] = src[col];
+            shade[2 * col] = src[col];
+        }
+    }
+    slot.has_shadow = true;
+
+    return s;
+}
+
+
 bool
 Font::has_char(Uint16 ch)
 {
-    return FT_Get_Char_Index(priv->face, ch);
+    const Uint32 bit = 1u << (ch & 31);
+    const int word = ch >> 5;
+    if (!(priv->char_known[word] & bit)) {
+        priv->char_known[word] |= bit;
+        if (FT_Get_Char_Index(priv->face, ch))
+            priv->char_present[word] |= bit;
+    }
+    return priv->char_present[word] & bit;
 }
@@ -24,6 +24,7 @@
 #define FONT_H
 
 #include <SDL.h>
+#include <vector>
 #include "resources.h"
 
 enum HintingMode { NoHinting = 0, LightHinting = 1, FullHinting = 2 };
@@ -61,6 +62,18 @@ struct Glyph {
     ~Glyph() { if (bitmap) SDL_FreeSurface(bitmap); }
 };
 
+// Coverage of a glyph merged with that of its drop shadow, over the
+// union of their boxes.  Each pixel is a (shadow, fill) pair of 8-bit
+// coverage values, so shadowed text can be composited in one pass.
+struct GlyphShadow {
+    int x, y;        // shadow offset this was derived for
+    int left, top;   // origin of the union box relative to the glyph bitmap
+    int w, h;
+    std::vector<Uint8> coverage;
+
+    GlyphShadow() : x(0), y(0), left(0), top(0), w(0), h(0) {}
+};
+
 class Font {
     FontInternals* priv;
 public:
@@ -75,6 +88,11 @@ public:
 
     void set_size(int val);
     Glyph render_glyph(Uint16 ch, SDL_Color fg, SDL_Color bg, float x_fractional_part);
+    // The same glyph merged with its drop shadow at offset (x, y).  This
+    // is derived from the cached bitmap the first time it is needed and
+    // kept alongside it; the reference is valid until the next render.
+    const GlyphShadow& render_shadow(Uint16 ch, float x_fractional_part,
+                                     int x, int y);
 
     int ascent();
     int lineskip();
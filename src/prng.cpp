@@ -14,9 +14,9 @@
 
 static long seed;
 
-void init_rnd()
+void init_rnd(long s)
 {
-    seed = time(NULL) % MODULUS;
+    seed = s ? s % MODULUS : time(NULL) % MODULUS;
     get_rnd(0, 0);
     get_rnd(0, 0);
     get_rnd(0, 0);